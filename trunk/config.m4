@@ -28,6 +28,9 @@ if test "$PHP_PYTHON" != "no"; then
     AC_CHECK_LIB(pthread, pthread_create, [
         PYTHON_LDFLAGS="-lpthread $PYTHON_LDFLAGS"
     ])
+    AC_CHECK_LIB(pthread, pthread_mutex_consistent, [
+        AC_DEFINE(HAVE_PTHREAD_MUTEX_CONSISTENT, 1, [Whether robust mutexes are available])
+    ])
     AC_CHECK_LIB(dl, dlopen, [
         PYTHON_LDFLAGS="-ldl $PYTHON_LDFLAGS"
     ])
@@ -65,5 +68,5 @@ if test "$PHP_PYTHON" != "no"; then
     PHP_EVAL_LIBLINE($PYTHON_LDFLAGS, PYTHON_SHARED_LIBADD)
     PHP_SUBST(PYTHON_SHARED_LIBADD)
 
-    PHP_NEW_EXTENSION(python, python.c python_convert.c python_handlers.c python_object.c python_php.c python_streams.c, $ext_shared)
+    PHP_NEW_EXTENSION(python, python.c python_convert.c python_handlers.c python_object.c python_php.c python_streams.c python_buffer.c python_code.c python_shm.c python_future.c python_coroutine.c python_parallel.c, $ext_shared)
 fi
@@ -54,5 +54,20 @@ PHP_FUNCTION(python_construct);
 PHP_FUNCTION(python_eval);
 PHP_FUNCTION(python_exec);
 PHP_FUNCTION(python_call);
+PHP_FUNCTION(python_compile);
+PHP_FUNCTION(python_exec_file);
+PHP_FUNCTION(python_session);
+PHP_FUNCTION(python_capture);
+PHP_FUNCTION(python_call_async);
+PHP_FUNCTION(python_await_all);
+PHP_FUNCTION(python_run_coroutine);
+PHP_FUNCTION(python_gather_coroutines);
+PHP_FUNCTION(python_parallel_map);
+PHP_FUNCTION(python_stream_output);
+
+PHP_FUNCTION(python_pack_doubles);
+PHP_FUNCTION(python_pack_longs);
+PHP_FUNCTION(python_unpack);
+PHP_FUNCTION(python_buffer);
 
 #endif /* PHP_PYTHON_H */
@@ -59,8 +59,22 @@
 	#define Py_ssize_t ssize_t
 #endif
 
+typedef struct _python_future python_future;
+
 ZEND_BEGIN_MODULE_GLOBALS(python)
     PyThreadState *tstate;
+    HashTable key_cache;
+    HashTable code_cache;
+    ulong code_cache_hits;
+    ulong code_cache_misses;
+    int thread_depth;
+    python_future *futures;
+    PyObject *asyncio;
+    PyObject *event_loop;
+    PyObject *output;
+    PyObject *errors;
+    PyObject *functions;
+    zend_object_handle convert_parent;
 ZEND_END_MODULE_GLOBALS(python)
 
 #ifdef ZTS
@@ -73,35 +87,133 @@ typedef struct _php_python_object {
 	zend_object			base;
 	PyObject *			object;
 	zend_class_entry *	ce;
+	zend_object_handle	parent;			/* the wrapper this was converted for */
 } php_python_object;
 
 #define PHP_PYTHON_FETCH(name, zv) php_python_object *name = (php_python_object *)zend_object_store_get_object(zv TSRMLS_CC)
 #define PHP_PYTHON_THREAD_ASSERT() assert(PyThreadState_GET() == PYG(tstate))
-#define PHP_PYTHON_THREAD_ACQUIRE() PyEval_AcquireThread(PYG(tstate))
-#define PHP_PYTHON_THREAD_RELEASE() PyEval_ReleaseThread(PyThreadState_GET())
+
+/*
+ * The request's thread state is acquired re-entrantly.  thread_depth counts
+ * the active acquisitions: only the outermost acquire and release actually
+ * swap the thread state, and nested ones just verify that the request's
+ * thread state is the one being held.  Every release hands control back to
+ * PHP, so buffered Python output is flushed first.
+ */
+#define PHP_PYTHON_THREAD_ACQUIRE() \
+	do { \
+		if (PYG(thread_depth)++ == 0) \
+			PyEval_AcquireThread(PYG(tstate)); \
+		else \
+			PHP_PYTHON_THREAD_ASSERT(); \
+	} while (0)
+#define PHP_PYTHON_THREAD_RELEASE() \
+	do { \
+		assert(PYG(thread_depth) > 0); \
+		python_streams_flush(TSRMLS_C); \
+		if (--PYG(thread_depth) == 0) \
+			PyEval_ReleaseThread(PYG(tstate)); \
+	} while (0)
+
+/*
+ * Suspending gives up the request's thread state completely, however deeply
+ * it is nested, so that other threads can run Python code while this one is
+ * busy in PHP.  Resuming restores the saved depth.
+ */
+#define PHP_PYTHON_THREAD_SUSPEND(depth) \
+	do { \
+		python_streams_flush(TSRMLS_C); \
+		(depth) = PYG(thread_depth); \
+		PYG(thread_depth) = 0; \
+		PyEval_ReleaseThread(PYG(tstate)); \
+	} while (0)
+#define PHP_PYTHON_THREAD_RESUME(depth) \
+	do { \
+		PyEval_AcquireThread(PYG(tstate)); \
+		PYG(thread_depth) = (depth); \
+	} while (0)
 
 /* Python Streams */
 int python_streams_init();
-int python_streams_intercept();
+int python_streams_intercept(TSRMLS_D);
+void python_streams_flush(TSRMLS_D);
+long python_streams_output(PyObject *iterable, long flush_size TSRMLS_DC);
+size_t python_streams_capture_start(TSRMLS_D);
+void python_streams_capture_end(size_t mark, zval *result TSRMLS_DC);
+void python_streams_shutdown(TSRMLS_D);
+void python_streams_destroy();
+int python_streams_register(PyObject *module);
+PyObject *python_stream_from_zval(zval *zv TSRMLS_DC);
+
+/* Python Buffers */
+int python_buffer_init();
+PyObject * python_buffer_pack(HashTable *ht, char format TSRMLS_DC);
+PyObject * python_buffer_wrap(zval *zv TSRMLS_DC);
+int python_buffer_unpack(PyObject *o, zval *zv TSRMLS_DC);
+
+/* Python Code */
+void python_code_cache_init(TSRMLS_D);
+void python_code_cache_destroy(TSRMLS_D);
+PyObject * python_code_compile(const char *source, int len, int start TSRMLS_DC);
+int python_code_init(TSRMLS_D);
+int python_code_wrap(PyObject *code, int start, zval *zv TSRMLS_DC);
+void python_file_cache_init();
+void python_file_cache_destroy();
+PyObject * python_code_compile_file(const char *filename TSRMLS_DC);
+int python_code_importer_install(TSRMLS_D);
+
+/* Python Shared Code Cache */
+int python_shm_init(size_t size);
+void python_shm_shutdown();
+PyObject * python_shm_fetch(const char *key, int key_len);
+void python_shm_store(const char *key, int key_len, PyObject *code);
+int python_shm_info(size_t *size, size_t *used, ulong *count);
+
+/* Python Futures */
+int python_future_init(TSRMLS_D);
+int python_future_start(PyObject *callable, PyObject *args, zval *zv TSRMLS_DC);
+int python_future_wait(zval *zv, double timeout, zval *result TSRMLS_DC);
+void python_future_join_all(TSRMLS_D);
+double python_future_now();
+
+/* Python Coroutines */
+PyObject * python_coroutine_run(PyObject *awaitable, double timeout TSRMLS_DC);
+PyObject * python_coroutine_gather(PyObject *awaitables, double timeout TSRMLS_DC);
+void python_coroutine_shutdown(TSRMLS_D);
+
+/* Python Parallel Map */
+PyObject * python_parallel_map(PyObject *function, PyObject *items, int workers TSRMLS_DC);
 
 /* Python Modules */
 int python_php_init(); 
+void python_php_shutdown(TSRMLS_D);
+PyObject * python_function_new(zval *callable TSRMLS_DC);
+zval * python_function_callable(PyObject *o);
+zval * python_array_zval(PyObject *o);
 
 /* PHP Object API */
 zend_object_value python_object_create(zend_class_entry *ce TSRMLS_DC);
+PyObject * python_object_from_zval(zval *zv TSRMLS_DC);
+php_python_object * python_object_find(zend_object_handle handle TSRMLS_DC);
 zend_uint python_get_arg_info(PyObject *callable, zend_arg_info **arg_info TSRMLS_DC) ;
 
 /* PHP to Python Conversion */
+void pip_key_cache_init(TSRMLS_D);
+void pip_key_cache_destroy(TSRMLS_D);
 PyObject * pip_hash_to_list(zval *hash TSRMLS_DC);
 PyObject * pip_hash_to_tuple(zval *hash TSRMLS_DC);
 PyObject * pip_hash_to_dict(zval *hash TSRMLS_DC);
 PyObject * pip_zobject_to_pyobject(zval *obj TSRMLS_DC);
 PyObject * pip_zval_to_pyobject(zval *val TSRMLS_DC);
+int pip_zval_is_callable(zval *val TSRMLS_DC);
 
 /* Python to PHP Conversion */
-int pip_sequence_to_hash(PyObject *o, HashTable *ht TSRMLS_DC);
+void pip_memo_init(HashTable *memo);
+void pip_memo_add(HashTable *memo, PyObject *o, zval *zv);
+zval * pip_memo_find(HashTable *memo, PyObject *o);
+int pip_sequence_to_hash(PyObject *o, HashTable *ht, HashTable *memo TSRMLS_DC);
 int pip_sequence_to_array(PyObject *o, zval *zv TSRMLS_DC);
-int pip_mapping_to_hash(PyObject *o, HashTable *ht TSRMLS_DC);
+int pip_mapping_to_hash(PyObject *o, HashTable *ht, HashTable *memo TSRMLS_DC);
 int pip_mapping_to_array(PyObject *o, zval *zv TSRMLS_DC);
 int pip_pyobject_to_zobject(PyObject *o, zval *zv TSRMLS_DC);
 int pip_pyobject_to_zval(PyObject *o, zval *zv TSRMLS_DC);
@@ -109,6 +221,9 @@ int pip_pyobject_to_zval(PyObject *o, zval *zv TSRMLS_DC);
 /* Argument Conversion */
 PyObject * pip_args_to_tuple(int argc, int start TSRMLS_DC);
 
+/* Error Handling */
+void python_error(int error_type TSRMLS_DC);
+
 /* Object Representations */
 int python_str(PyObject *o, char **buffer, int *length TSRMLS_DC);
 
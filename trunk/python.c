@@ -45,6 +45,20 @@ zend_function_entry python_functions[] = {
 	PHP_FE(python_eval,			NULL)
 	PHP_FE(python_exec,			NULL)
 	PHP_FE(python_call,			NULL)
+	PHP_FE(python_compile,		NULL)
+	PHP_FE(python_exec_file,	NULL)
+	PHP_FE(python_session,		NULL)
+	PHP_FE(python_capture,		NULL)
+	PHP_FE(python_call_async,	NULL)
+	PHP_FE(python_await_all,	NULL)
+	PHP_FE(python_run_coroutine,	NULL)
+	PHP_FE(python_gather_coroutines,	NULL)
+	PHP_FE(python_parallel_map,	NULL)
+	PHP_FE(python_stream_output,	NULL)
+	PHP_FE(python_pack_doubles,	NULL)
+	PHP_FE(python_pack_longs,	NULL)
+	PHP_FE(python_unpack,		NULL)
+	PHP_FE(python_buffer,		NULL)
 	{NULL, NULL, NULL}
 };
 /* }}} */
@@ -89,6 +103,15 @@ zend_internal_function php_python_constructor = {
  */
 PHP_INI_BEGIN()
 PHP_INI_ENTRY("python.optimize", "0", PHP_INI_SYSTEM, NULL)
+PHP_INI_ENTRY("python.code_cache_size", "64", PHP_INI_ALL, NULL)
+PHP_INI_ENTRY("python.shm_size", "0", PHP_INI_SYSTEM, NULL)
+PHP_INI_ENTRY("python.validate_timestamps", "1", PHP_INI_ALL, NULL)
+PHP_INI_ENTRY("python.coroutine_timeout", "0", PHP_INI_ALL, NULL)
+PHP_INI_ENTRY("python.output_buffer_size", "8192", PHP_INI_SYSTEM|PHP_INI_PERDIR, NULL)
+PHP_INI_ENTRY("python.stderr_sink", "error", PHP_INI_SYSTEM|PHP_INI_PERDIR, NULL)
+PHP_INI_ENTRY("python.stderr_level", "8", PHP_INI_SYSTEM|PHP_INI_PERDIR, NULL)
+PHP_INI_ENTRY("python.stderr_file", "", PHP_INI_SYSTEM, NULL)
+PHP_INI_ENTRY("python.stream_flush_size", "0", PHP_INI_ALL, NULL)
 PHP_INI_END()
 /* }}} */
 
@@ -118,6 +141,9 @@ PHP_MINIT_FUNCTION(python)
 	python_class_entry->create_object = python_object_create;
 	python_class_entry->constructor = (zend_function *)&php_python_constructor;
 
+	python_code_init(TSRMLS_C);
+	python_future_init(TSRMLS_C);
+
 	/*
 	 * We need to set up any flags before we initialize Python.  Note that we
 	 * always skip signal handler registration to avoid interfering with PHP's
@@ -133,6 +159,17 @@ PHP_MINIT_FUNCTION(python)
 	PyEval_InitThreads();
 
 	python_streams_init();
+	python_buffer_init();
+
+	/* Compiled files are cached for the lifetime of the process. */
+	python_file_cache_init();
+
+	/*
+	 * The shared code cache must be mapped now, before the SAPI forks its
+	 * worker processes, so that they all inherit the same segment.
+	 */
+	python_shm_init((size_t)zend_atol(INI_STR("python.shm_size"),
+									  strlen(INI_STR("python.shm_size"))));
 
 	PyThreadState_Swap(NULL);
 	PyEval_ReleaseLock();
@@ -172,6 +209,10 @@ PHP_MSHUTDOWN_FUNCTION(python)
 	PyThreadState_Swap(NULL);
 	PyEval_ReleaseLock();
 
+	python_file_cache_destroy();
+	python_shm_shutdown();
+	python_streams_destroy();
+
 	return SUCCESS;
 }
 /* }}} */
@@ -198,18 +239,33 @@ PHP_RINIT_FUNCTION(python)
 	 * Intercept Python's stdout and stderr streams and install appropriate
 	 * PHP handlers.
 	 */
-	python_streams_intercept();
+	python_streams_intercept(TSRMLS_C);
 
 	/*
 	 * Register all of our Python modules in this interpreter's environment.
 	 */
 	python_php_init();
 
+	/* Set up the cache of PHP hash keys converted to Python strings. */
+	pip_key_cache_init(TSRMLS_C);
+
+	/* Set up the cache of compiled python_eval() and python_exec() code. */
+	python_code_cache_init(TSRMLS_C);
+
+	/* Load source modules through the shared code cache, if it's enabled. */
+	python_code_importer_install(TSRMLS_C);
+
 	/*
 	 * Save our thread state in a global variable and release our lock.  This
 	 * request's Python environment is now set up and ready to use.
 	 */
 	PYG(tstate) = tstate;
+	PYG(thread_depth) = 0;
+	PYG(futures) = NULL;
+	PYG(asyncio) = NULL;
+	PYG(event_loop) = NULL;
+	PYG(functions) = NULL;
+	PYG(convert_parent) = 0;
 	PyThreadState_Swap(NULL);
 	PyEval_ReleaseLock();
 
@@ -223,7 +279,27 @@ PHP_RSHUTDOWN_FUNCTION(python)
 	PyThreadState *tstate;
 
 	tstate = PYG(tstate);
-	PyEval_AcquireThread(tstate);
+
+	/* Worker threads must finish before their interpreter is destroyed. */
+	python_future_join_all(TSRMLS_C);
+
+	/*
+	 * If the request bailed out while holding the thread state (from inside
+	 * a PHP callback, for example), we still hold it and must not try to
+	 * acquire it again.
+	 */
+	if (PYG(thread_depth))
+		PYG(thread_depth) = 0;
+	else
+		PyEval_AcquireThread(tstate);
+
+	/* Release our cached objects while we still hold the thread state. */
+	python_coroutine_shutdown(TSRMLS_C);
+	python_php_shutdown(TSRMLS_C);
+	python_streams_shutdown(TSRMLS_C);
+	python_code_cache_destroy(TSRMLS_C);
+	pip_key_cache_destroy(TSRMLS_C);
+
 	Py_EndInterpreter(tstate);
 
 	return SUCCESS;
@@ -233,12 +309,36 @@ PHP_RSHUTDOWN_FUNCTION(python)
  */
 PHP_MINFO_FUNCTION(python)
 {
+	size_t shm_size, shm_used;
+	ulong shm_count;
+	char buf[32];
+
 	php_info_print_table_start();
 	php_info_print_table_header(2, "Python Support", "enabled");
 	php_info_print_table_row(2, "Python Version", Py_GetVersion());
 	php_info_print_table_row(2, "Extension Version", PHP_PYTHON_VERSION);
 	php_info_print_table_end();
 
+	php_info_print_table_start();
+	php_info_print_table_header(2, "Code Cache (this process)", "");
+	snprintf(buf, sizeof(buf), "%lu", PYG(code_cache_hits));
+	php_info_print_table_row(2, "Hits", buf);
+	snprintf(buf, sizeof(buf), "%lu", PYG(code_cache_misses));
+	php_info_print_table_row(2, "Misses", buf);
+	php_info_print_table_end();
+
+	if (python_shm_info(&shm_size, &shm_used, &shm_count) == SUCCESS) {
+		php_info_print_table_start();
+		php_info_print_table_header(2, "Shared Code Cache", "");
+		snprintf(buf, sizeof(buf), "%lu", (unsigned long)shm_size);
+		php_info_print_table_row(2, "Size", buf);
+		snprintf(buf, sizeof(buf), "%lu", (unsigned long)shm_used);
+		php_info_print_table_row(2, "Used", buf);
+		snprintf(buf, sizeof(buf), "%lu", shm_count);
+		php_info_print_table_row(2, "Entries", buf);
+		php_info_print_table_end();
+	}
+
 	DISPLAY_INI_ENTRIES();
 
 	php_info_print_table_start();
@@ -257,7 +357,7 @@ PHP_MINFO_FUNCTION(python)
 
 /* {{{ python_error(int error_type TSRMLS_DC)
  */
-static void
+void
 python_error(int error_type TSRMLS_DC)
 {
 	PyObject *ptype, *pvalue, *ptraceback;
@@ -265,6 +365,9 @@ python_error(int error_type TSRMLS_DC)
 
 	PHP_PYTHON_THREAD_ASSERT();
 
+	/* Keep the error in order with the output that preceded it. */
+	python_streams_flush(TSRMLS_C);
+
 	/* Fetch the last error and store the type and value as strings. */
 	PyErr_Fetch(&ptype, &pvalue, &ptraceback);
 	type = PyObject_Str(ptype);
@@ -369,7 +472,7 @@ PHP_FUNCTION(python_construct)
    Evaluate a string of code by passing it to the Python interpreter. */
 PHP_FUNCTION(python_eval)
 {
-	PyObject *m, *d, *v;
+	PyObject *m, *d, *code, *v;
 	char *expr;
 	int len;
 
@@ -395,8 +498,17 @@ PHP_FUNCTION(python_eval)
 	 * The string is evaluated as a single, isolated expression.  It is not
 	 * treated as a statement or as series of statements.  This allows us to
 	 * retrieve the resulting value of the evaluated expression.
+	 *
+	 * The compiled code object comes from the request's code cache, so
+	 * evaluating the same expression repeatedly only compiles it once.
 	 */
-	v = PyRun_String(expr, Py_eval_input, d, d);
+	code = python_code_compile(expr, len, Py_eval_input TSRMLS_CC);
+	if (code) {
+		v = PyEval_EvalCode((PyCodeObject *)code, d, d);
+		Py_DECREF(code);
+	} else
+		v = NULL;
+
 	if (v == NULL) {
 		python_error(E_WARNING TSRMLS_CC);
 		PHP_PYTHON_THREAD_RELEASE();
@@ -423,7 +535,7 @@ PHP_FUNCTION(python_eval)
    Execute a string of code by passing it to the Python interpreter. */
 PHP_FUNCTION(python_exec)
 {
-	PyObject *m, *d, *v;
+	PyObject *m, *d, *code, *v;
 	char *command;
 	int len;
 
@@ -450,7 +562,13 @@ PHP_FUNCTION(python_exec)
 	 * can only detect the overall success or failure of the execution.  We
 	 * cannot return any other kind of result value.
 	 */
-	v = PyRun_String(command, Py_file_input, d, d);
+	code = python_code_compile(command, len, Py_file_input TSRMLS_CC);
+	if (code) {
+		v = PyEval_EvalCode((PyCodeObject *)code, d, d);
+		Py_DECREF(code);
+	} else
+		v = NULL;
+
 	if (v == NULL) {
 		python_error(E_WARNING TSRMLS_CC);
 		PHP_PYTHON_THREAD_RELEASE();
@@ -519,6 +637,669 @@ PHP_FUNCTION(python_call)
 	PHP_PYTHON_THREAD_RELEASE();
 }
 /* }}} */
+/* {{{ python_pack(INTERNAL_FUNCTION_PARAMETERS, char format)
+ */
+static void
+python_pack(INTERNAL_FUNCTION_PARAMETERS, char format)
+{
+	zval *values;
+	PyObject *buffer;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a",
+							  &values) == FAILURE) {
+		return;
+	}
+
+	PHP_PYTHON_THREAD_ACQUIRE();
+
+	buffer = python_buffer_pack(Z_ARRVAL_P(values), format TSRMLS_CC);
+	if (buffer) {
+		pip_pyobject_to_zobject(buffer, return_value TSRMLS_CC);
+		Py_DECREF(buffer);
+	} else {
+		python_error(E_WARNING TSRMLS_CC);
+		RETVAL_FALSE;
+	}
+
+	PHP_PYTHON_THREAD_RELEASE();
+}
+/* }}} */
+/* {{{ proto object python_pack_doubles(array values)
+   Pack an array's values into a Python buffer of C doubles. */
+PHP_FUNCTION(python_pack_doubles)
+{
+	python_pack(INTERNAL_FUNCTION_PARAM_PASSTHRU, 'd');
+}
+/* }}} */
+/* {{{ proto object python_pack_longs(array values)
+   Pack an array's values into a Python buffer of C longs. */
+PHP_FUNCTION(python_pack_longs)
+{
+	python_pack(INTERNAL_FUNCTION_PARAM_PASSTHRU, 'l');
+}
+/* }}} */
+/* {{{ proto array python_unpack(object buffer)
+   Unpack a Python object's numeric buffer into a packed array. */
+PHP_FUNCTION(python_unpack)
+{
+	zval *zbuffer;
+	PyObject *buffer;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o",
+							  &zbuffer) == FAILURE) {
+		return;
+	}
+
+	buffer = python_object_from_zval(zbuffer TSRMLS_CC);
+	if (buffer == NULL) {
+		php_error(E_WARNING, "Python: Expected a Python object");
+		RETURN_FALSE;
+	}
+
+	PHP_PYTHON_THREAD_ACQUIRE();
+
+	if (python_buffer_unpack(buffer, return_value TSRMLS_CC) == FAILURE) {
+		python_error(E_WARNING TSRMLS_CC);
+		zval_dtor(return_value);
+		RETVAL_FALSE;
+	}
+
+	PHP_PYTHON_THREAD_RELEASE();
+}
+/* }}} */
+/* {{{ proto object python_buffer(string data)
+   Expose a string to Python as a read-only buffer without copying it. */
+PHP_FUNCTION(python_buffer)
+{
+	zval *data;
+	PyObject *buffer;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "z",
+							  &data) == FAILURE) {
+		return;
+	}
+
+	if (Z_TYPE_P(data) != IS_STRING) {
+		php_error(E_WARNING, "Python: Expected a string");
+		RETURN_FALSE;
+	}
+
+	PHP_PYTHON_THREAD_ACQUIRE();
+
+	buffer = python_buffer_wrap(data TSRMLS_CC);
+	if (buffer) {
+		pip_pyobject_to_zobject(buffer, return_value TSRMLS_CC);
+		Py_DECREF(buffer);
+	} else {
+		python_error(E_WARNING TSRMLS_CC);
+		RETVAL_FALSE;
+	}
+
+	PHP_PYTHON_THREAD_RELEASE();
+}
+/* }}} */
+/* {{{ proto PythonCode python_compile(string source[, string mode])
+   Compile a string of Python code into a reusable PythonCode object.  The
+   mode is either 'exec' (the default) for a series of statements or 'eval'
+   for a single expression. */
+PHP_FUNCTION(python_compile)
+{
+	PyObject *code;
+	char *source, *mode = "exec";
+	int len, mode_len = 4, start;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s|s", &source, &len,
+							  &mode, &mode_len) == FAILURE) {
+		return;
+	}
+
+	if (strcmp(mode, "exec") == 0)
+		start = Py_file_input;
+	else if (strcmp(mode, "eval") == 0)
+		start = Py_eval_input;
+	else {
+		php_error(E_WARNING, "Python: Unknown compile mode '%s'", mode);
+		RETURN_FALSE;
+	}
+
+	PHP_PYTHON_THREAD_ACQUIRE();
+
+	code = python_code_compile(source, len, start TSRMLS_CC);
+	if (code == NULL) {
+		python_error(E_WARNING TSRMLS_CC);
+		RETVAL_FALSE;
+	} else if (python_code_wrap(code, start, return_value TSRMLS_CC) == FAILURE)
+		RETVAL_FALSE;
+
+	PHP_PYTHON_THREAD_RELEASE();
+}
+/* }}} */
+/* {{{ proto bool python_exec_file(string filename[, array globals])
+   Execute a Python source file in a new namespace seeded with the given
+   global variables.  The compiled code is cached between requests. */
+PHP_FUNCTION(python_exec_file)
+{
+	PyObject *d, *code, *v;
+	zval *globals = NULL;
+	char *filename;
+	int len;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "s|a", &filename,
+							  &len, &globals) == FAILURE) {
+		return;
+	}
+
+	PHP_PYTHON_THREAD_ACQUIRE();
+
+	code = python_code_compile_file(filename TSRMLS_CC);
+	if (code == NULL) {
+		python_error(E_WARNING TSRMLS_CC);
+		PHP_PYTHON_THREAD_RELEASE();
+		RETURN_FALSE;
+	}
+
+	/*
+	 * The file runs as a script, with its own namespace, rather than in
+	 * __main__'s dictionary like python_exec().
+	 */
+	d = globals ? pip_hash_to_dict(globals TSRMLS_CC) : PyDict_New();
+	if (d == NULL) {
+		Py_DECREF(code);
+		python_error(E_WARNING TSRMLS_CC);
+		PHP_PYTHON_THREAD_RELEASE();
+		RETURN_FALSE;
+	}
+
+	if (PyDict_GetItemString(d, "__builtins__") == NULL)
+		PyDict_SetItemString(d, "__builtins__", PyEval_GetBuiltins());
+	if (PyDict_GetItemString(d, "__name__") == NULL) {
+		v = PyString_FromString("__main__");
+		PyDict_SetItemString(d, "__name__", v);
+		Py_XDECREF(v);
+	}
+	v = PyString_FromStringAndSize(filename, len);
+	PyDict_SetItemString(d, "__file__", v);
+	Py_XDECREF(v);
+
+	v = PyEval_EvalCode((PyCodeObject *)code, d, d);
+	Py_DECREF(code);
+	Py_DECREF(d);
+
+	if (v == NULL) {
+		python_error(E_WARNING TSRMLS_CC);
+		RETVAL_FALSE;
+	} else {
+		Py_DECREF(v);
+		RETVAL_TRUE;
+	}
+
+	PHP_PYTHON_THREAD_RELEASE();
+}
+/* }}} */
+/* {{{ proto mixed python_session(callback function[, mixed ...])
+   Call a PHP function while holding this request's Python thread state, so
+   that any Python operations it performs don't each acquire and release it.
+   Returns the function's return value. */
+PHP_FUNCTION(python_session)
+{
+	zend_fcall_info fci;
+	zend_fcall_info_cache fcc;
+	zval *retval = NULL;
+
+	fci.params = NULL;
+	fci.param_count = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "f*", &fci, &fcc,
+							  &fci.params, &fci.param_count) == FAILURE) {
+		return;
+	}
+
+	fci.retval_ptr_ptr = &retval;
+
+	/*
+	 * Because acquisitions nest, everything the function does with Python
+	 * reuses this acquisition instead of swapping the thread state.
+	 */
+	PHP_PYTHON_THREAD_ACQUIRE();
+	zend_call_function(&fci, &fcc TSRMLS_CC);
+	PHP_PYTHON_THREAD_RELEASE();
+
+	if (fci.params)
+		efree(fci.params);
+
+	if (retval)
+		COPY_PZVAL_TO_ZVAL(*return_value, retval);
+}
+/* }}} */
+/* {{{ proto string python_capture(callback function[, mixed ...])
+   Call a PHP function and return everything Python writes to sys.stdout
+   while it runs, instead of sending it to the output.  The function's own
+   return value is discarded. */
+PHP_FUNCTION(python_capture)
+{
+	zend_fcall_info fci;
+	zend_fcall_info_cache fcc;
+	zval *retval = NULL;
+	size_t mark;
+
+	fci.params = NULL;
+	fci.param_count = 0;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "f*", &fci, &fcc,
+							  &fci.params, &fci.param_count) == FAILURE) {
+		return;
+	}
+
+	fci.retval_ptr_ptr = &retval;
+
+	/*
+	 * The output is collected in sys.stdout's own buffer, bypassing PHP's
+	 * output layer, and copied into the result in one piece.  As with
+	 * python_session(), the thread state is held for the whole call.
+	 */
+	PHP_PYTHON_THREAD_ACQUIRE();
+	mark = python_streams_capture_start(TSRMLS_C);
+	zend_call_function(&fci, &fcc TSRMLS_CC);
+	python_streams_capture_end(mark, return_value TSRMLS_CC);
+	PHP_PYTHON_THREAD_RELEASE();
+
+	if (fci.params)
+		efree(fci.params);
+
+	if (retval)
+		zval_ptr_dtor(&retval);
+}
+/* }}} */
+/* {{{ proto PythonFuture python_call_async(string module, string function[, mixed ...])
+   Call a Python function on a worker thread and return a PythonFuture for
+   its result. */
+PHP_FUNCTION(python_call_async)
+{
+	char *module_name, *function_name;
+	int module_name_len, function_name_len;
+	PyObject *module, *function, *args;
+
+	/* Parse only the first two parameters (module name and function name). */
+	if (zend_parse_parameters(2 TSRMLS_CC, "ss", &module_name, &module_name_len,
+							  &function_name, &function_name_len) == FAILURE) {
+		return;
+	}
+
+	PHP_PYTHON_THREAD_ACQUIRE();
+
+	module = PyImport_ImportModule(module_name);
+	if (module == NULL) {
+		python_error(E_WARNING TSRMLS_CC);
+		PHP_PYTHON_THREAD_RELEASE();
+		RETURN_FALSE;
+	}
+
+	function = PyDict_GetItemString(PyModule_GetDict(module), function_name);
+	if (function == NULL) {
+		php_error(E_WARNING, "Python: '%s.%s' is not a callable object",
+				  module_name, function_name);
+		Py_DECREF(module);
+		PHP_PYTHON_THREAD_RELEASE();
+		RETURN_FALSE;
+	}
+
+	/* The arguments are converted here, on the request's thread. */
+	args = pip_args_to_tuple(ZEND_NUM_ARGS(), 2 TSRMLS_CC);
+
+	if (python_future_start(function, args, return_value TSRMLS_CC) == FAILURE) {
+		python_error(E_WARNING TSRMLS_CC);
+		zval_dtor(return_value);
+		RETVAL_FALSE;
+	}
+
+	Py_XDECREF(args);
+	Py_DECREF(module);
+
+	PHP_PYTHON_THREAD_RELEASE();
+}
+/* }}} */
+/* {{{ proto array python_await_all(array futures[, float timeout])
+   Wait for all of the given PythonFuture objects and return an array of
+   their results, with the same keys.  The timeout (in seconds) applies to
+   the group as a whole; calls that fail or don't finish in time produce
+   NULL results. */
+PHP_FUNCTION(python_await_all)
+{
+	zval *futures, **entry, *result;
+	double timeout = -1, deadline = 0, remaining = -1;
+	HashPosition pos;
+	char *key;
+	uint key_len;
+	ulong index;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a|d", &futures,
+							  &timeout) == FAILURE) {
+		return;
+	}
+
+	if (timeout >= 0)
+		deadline = python_future_now() + timeout;
+
+	array_init(return_value);
+
+	for (zend_hash_internal_pointer_reset_ex(Z_ARRVAL_P(futures), &pos);
+		 zend_hash_get_current_data_ex(Z_ARRVAL_P(futures), (void **)&entry,
+									   &pos) == SUCCESS;
+		 zend_hash_move_forward_ex(Z_ARRVAL_P(futures), &pos)) {
+
+		if (timeout >= 0) {
+			remaining = deadline - python_future_now();
+			if (remaining < 0)
+				remaining = 0;
+		}
+
+		ALLOC_INIT_ZVAL(result);
+		if (python_future_wait(*entry, remaining, result TSRMLS_CC) == FAILURE) {
+			zval_dtor(result);
+			ZVAL_NULL(result);
+		}
+
+		if (zend_hash_get_current_key_ex(Z_ARRVAL_P(futures), &key, &key_len,
+										 &index, 0, &pos) == HASH_KEY_IS_STRING)
+			add_assoc_zval_ex(return_value, key, key_len, result);
+		else
+			add_index_zval(return_value, index, result);
+	}
+}
+/* }}} */
+/* {{{ python_call_array(zval *call TSRMLS_DC)
+   Call the Python function described by an array of the form
+   array(module, function, arg, ...).  Returns a new reference to the
+   result, or NULL with a Python exception set. */
+static PyObject *
+python_call_array(zval *call TSRMLS_DC)
+{
+	PyObject *module = NULL, *function = NULL, *args, *result = NULL;
+	HashTable *ht = Z_ARRVAL_P(call);
+	HashPosition pos;
+	zval **entry, tmp;
+	int i = 0, n = zend_hash_num_elements(ht);
+
+	if (n < 2) {
+		PyErr_SetString(PyExc_ValueError,
+						"Expected array(module, function, ...)");
+		return NULL;
+	}
+
+	args = PyTuple_New(n - 2);
+	if (args == NULL)
+		return NULL;
+
+	for (zend_hash_internal_pointer_reset_ex(ht, &pos);
+		 zend_hash_get_current_data_ex(ht, (void **)&entry, &pos) == SUCCESS;
+		 zend_hash_move_forward_ex(ht, &pos), ++i) {
+
+		if (i >= 2) {
+			PyTuple_SET_ITEM(args, i - 2, pip_zval_to_pyobject(*entry TSRMLS_CC));
+			continue;
+		}
+
+		tmp = **entry;
+		zval_copy_ctor(&tmp);
+		convert_to_string(&tmp);
+
+		if (i == 0)
+			module = PyImport_ImportModule(Z_STRVAL(tmp));
+		else if (module)
+			function = PyObject_GetAttrString(module, Z_STRVAL(tmp));
+
+		zval_dtor(&tmp);
+	}
+
+	if (function)
+		result = PyObject_CallObject(function, args);
+
+	Py_XDECREF(function);
+	Py_XDECREF(module);
+	Py_DECREF(args);
+
+	return result;
+}
+/* }}} */
+/* {{{ proto int python_stream_output(string module, string function[, mixed ...])
+   Call a Python function that returns an iterable of strings (typically a
+   generator) and write each string to the output as it is produced.  The
+   SAPI is flushed after every python.stream_flush_size bytes.  Returns the
+   number of bytes written. */
+PHP_FUNCTION(python_stream_output)
+{
+	char *module_name, *function_name;
+	int module_name_len, function_name_len;
+	PyObject *module, *function, *args, *iterable;
+	long written = -1;
+
+	/* Parse only the first two parameters (module name and function name). */
+	if (zend_parse_parameters(2 TSRMLS_CC, "ss", &module_name, &module_name_len,
+							  &function_name, &function_name_len) == FAILURE) {
+		return;
+	}
+
+	PHP_PYTHON_THREAD_ACQUIRE();
+
+	module = PyImport_ImportModule(module_name);
+	if (module) {
+		function = PyObject_GetAttrString(module, function_name);
+		if (function) {
+			args = pip_args_to_tuple(ZEND_NUM_ARGS(), 2 TSRMLS_CC);
+			iterable = PyObject_CallObject(function, args);
+			Py_XDECREF(args);
+
+			if (iterable) {
+				written = python_streams_output(iterable,
+						INI_INT("python.stream_flush_size") TSRMLS_CC);
+				Py_DECREF(iterable);
+			}
+			Py_DECREF(function);
+		}
+		Py_DECREF(module);
+	}
+
+	if (written < 0) {
+		python_error(E_WARNING TSRMLS_CC);
+		RETVAL_FALSE;
+	} else
+		RETVAL_LONG(written);
+
+	PHP_PYTHON_THREAD_RELEASE();
+}
+/* }}} */
+/* {{{ proto mixed python_run_coroutine(string module, string function[, mixed ...])
+   Call a Python coroutine function and run the request's event loop until
+   the coroutine completes, or until python.coroutine_timeout seconds pass.
+   Returns the coroutine's result. */
+PHP_FUNCTION(python_run_coroutine)
+{
+	char *module_name, *function_name;
+	int module_name_len, function_name_len;
+	PyObject *module, *function, *args, *coroutine, *result = NULL;
+
+	/* Parse only the first two parameters (module name and function name). */
+	if (zend_parse_parameters(2 TSRMLS_CC, "ss", &module_name, &module_name_len,
+							  &function_name, &function_name_len) == FAILURE) {
+		return;
+	}
+
+	PHP_PYTHON_THREAD_ACQUIRE();
+
+	module = PyImport_ImportModule(module_name);
+	if (module) {
+		function = PyObject_GetAttrString(module, function_name);
+		if (function) {
+			args = pip_args_to_tuple(ZEND_NUM_ARGS(), 2 TSRMLS_CC);
+			coroutine = PyObject_CallObject(function, args);
+			Py_XDECREF(args);
+
+			if (coroutine) {
+				result = python_coroutine_run(coroutine,
+						INI_FLT("python.coroutine_timeout") TSRMLS_CC);
+				Py_DECREF(coroutine);
+			}
+			Py_DECREF(function);
+		}
+		Py_DECREF(module);
+	}
+
+	if (result) {
+		pip_pyobject_to_zval(result, return_value TSRMLS_CC);
+		Py_DECREF(result);
+	} else
+		python_error(E_WARNING TSRMLS_CC);
+
+	PHP_PYTHON_THREAD_RELEASE();
+}
+/* }}} */
+/* {{{ proto array python_gather_coroutines(array calls[, float timeout])
+   Run several Python coroutines concurrently on the request's event loop.
+   Each call is an array of the form array(module, function, arg, ...).
+   Returns an array of results with the same keys; coroutines that raised
+   produce NULL results.  Returns false if the timeout (in seconds) expires
+   before all of them complete. */
+PHP_FUNCTION(python_gather_coroutines)
+{
+	zval *calls, **entry, *item;
+	double timeout = -1;
+	PyObject *coroutines, *coroutine, *results;
+	HashPosition pos;
+	char *key;
+	uint key_len;
+	ulong index;
+	int i, key_type;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a|d", &calls,
+							  &timeout) == FAILURE) {
+		return;
+	}
+
+	if (timeout < 0)
+		timeout = INI_FLT("python.coroutine_timeout");
+
+	PHP_PYTHON_THREAD_ACQUIRE();
+
+	coroutines = PyList_New(0);
+	if (coroutines == NULL) {
+		python_error(E_WARNING TSRMLS_CC);
+		PHP_PYTHON_THREAD_RELEASE();
+		RETURN_FALSE;
+	}
+
+	for (zend_hash_internal_pointer_reset_ex(Z_ARRVAL_P(calls), &pos);
+		 zend_hash_get_current_data_ex(Z_ARRVAL_P(calls), (void **)&entry,
+									   &pos) == SUCCESS;
+		 zend_hash_move_forward_ex(Z_ARRVAL_P(calls), &pos)) {
+
+		if (Z_TYPE_PP(entry) != IS_ARRAY) {
+			PyErr_SetString(PyExc_ValueError,
+							"Expected array(module, function, ...)");
+			coroutine = NULL;
+		} else
+			coroutine = python_call_array(*entry TSRMLS_CC);
+
+		if (coroutine == NULL || PyList_Append(coroutines, coroutine) < 0) {
+			Py_XDECREF(coroutine);
+			Py_DECREF(coroutines);
+			python_error(E_WARNING TSRMLS_CC);
+			PHP_PYTHON_THREAD_RELEASE();
+			RETURN_FALSE;
+		}
+
+		Py_DECREF(coroutine);
+	}
+
+	results = python_coroutine_gather(coroutines, timeout TSRMLS_CC);
+	Py_DECREF(coroutines);
+
+	if (results == NULL) {
+		python_error(E_WARNING TSRMLS_CC);
+		PHP_PYTHON_THREAD_RELEASE();
+		RETURN_FALSE;
+	}
+
+	array_init(return_value);
+
+	for (i = 0, zend_hash_internal_pointer_reset_ex(Z_ARRVAL_P(calls), &pos);
+		 i < PySequence_Size(results) &&
+		 (key_type = zend_hash_get_current_key_ex(Z_ARRVAL_P(calls), &key,
+					&key_len, &index, 0, &pos)) != HASH_KEY_NON_EXISTANT;
+		 ++i, zend_hash_move_forward_ex(Z_ARRVAL_P(calls), &pos)) {
+		PyObject *result = PySequence_GetItem(results, i);
+
+		ALLOC_INIT_ZVAL(item);
+
+		/* Report each coroutine's exception, and give it a NULL result. */
+		if (result && PyExceptionInstance_Check(result)) {
+			PyErr_SetObject((PyObject *)Py_TYPE(result), result);
+			python_error(E_WARNING TSRMLS_CC);
+		} else if (result == NULL ||
+				   pip_pyobject_to_zval(result, item TSRMLS_CC) == FAILURE) {
+			PyErr_Clear();
+			zval_dtor(item);
+			ZVAL_NULL(item);
+		}
+		Py_XDECREF(result);
+
+		if (key_type == HASH_KEY_IS_STRING)
+			add_assoc_zval_ex(return_value, key, key_len, item);
+		else
+			add_index_zval(return_value, index, item);
+	}
+
+	Py_DECREF(results);
+
+	PHP_PYTHON_THREAD_RELEASE();
+}
+/* }}} */
+/* {{{ proto array python_parallel_map(mixed callable, array items[, int workers])
+   Call a Python callable (a Python object) or a PHP callable on each of the
+   items, spreading the work over up to the given number of worker
+   processes, and return an array of the results in the same order. */
+PHP_FUNCTION(python_parallel_map)
+{
+	long workers = 2;
+	zval *callable, *items;
+	PyObject *function, *list = NULL, *results = NULL;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "za|l",
+							  &callable, &items, &workers) == FAILURE) {
+		return;
+	}
+
+	if (workers < 1) {
+		php_error(E_WARNING, "Python: The number of workers must be positive");
+		RETURN_FALSE;
+	}
+
+	PHP_PYTHON_THREAD_ACQUIRE();
+
+	/* PHP callables are called through a php.Function object. */
+	function = python_object_from_zval(callable TSRMLS_CC);
+	if (function)
+		Py_INCREF(function);
+	else
+		function = python_function_new(callable TSRMLS_CC);
+	if (function)
+		list = pip_hash_to_list(items TSRMLS_CC);
+	if (list)
+		results = python_parallel_map(function, list, (int)workers TSRMLS_CC);
+
+	if (results == NULL ||
+		pip_sequence_to_array(results, return_value TSRMLS_CC) == FAILURE) {
+		python_error(E_WARNING TSRMLS_CC);
+		zval_dtor(return_value);
+		RETVAL_FALSE;
+	}
+
+	Py_XDECREF(results);
+	Py_XDECREF(list);
+	Py_XDECREF(function);
+
+	PHP_PYTHON_THREAD_RELEASE();
+}
+/* }}} */
 
 /*
  * Local variables:
@@ -0,0 +1,529 @@
+/*
+ * Python in PHP - Embedded Python Extension
+ *
+ * Copyright (c) 2003,2004,2005,2006,2007,2008 Jon Parise <jon@php.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * $Id$
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "php_python_internal.h"
+
+ZEND_EXTERN_MODULE_GLOBALS(python);
+
+/* {{{ Buffer
+ */
+typedef struct {
+	PyObject_HEAD
+	char *			data;		/* contiguous item storage */
+	Py_ssize_t		len;		/* length of the storage in bytes */
+	Py_ssize_t		nitems;		/* number of items */
+	Py_ssize_t		itemsize;	/* size of a single item in bytes */
+	char			format[2];	/* struct module format of an item */
+	int				readonly;
+	zval *			owner;		/* PHP value that owns data, if any */
+} Buffer;
+
+static PyTypeObject Buffer_Type;
+
+/* {{{ Buffer_dealloc
+ */
+static void
+Buffer_dealloc(Buffer *self)
+{
+	/*
+	 * If our storage belongs to a PHP value, we just drop our reference to
+	 * that value.  Otherwise, the storage is ours to free.  PHP values can
+	 * only be released on the request's thread, so anywhere else the value
+	 * is leaked rather than freed with the wrong allocator.
+	 */
+	if (self->owner) {
+		TSRMLS_FETCH();
+		if (PyThreadState_GET() == PYG(tstate))
+			zval_ptr_dtor(&self->owner);
+	} else
+		PyMem_Free(self->data);
+
+	PyObject_Del(self);
+}
+/* }}} */
+
+/* {{{ Buffer_length
+ */
+static Py_ssize_t
+Buffer_length(Buffer *self)
+{
+	return self->nitems;
+}
+/* }}} */
+/* {{{ Buffer_item
+ */
+static PyObject *
+Buffer_item(Buffer *self, Py_ssize_t i)
+{
+	if (i < 0 || i >= self->nitems) {
+		PyErr_SetString(PyExc_IndexError, "Buffer index out of range");
+		return NULL;
+	}
+
+	switch (self->format[0]) {
+		case 'd':
+			return PyFloat_FromDouble(((double *)self->data)[i]);
+		case 'l':
+			return PyInt_FromLong(((long *)self->data)[i]);
+		default:
+			return PyInt_FromLong(((unsigned char *)self->data)[i]);
+	}
+}
+/* }}} */
+
+/* {{{ Buffer_getreadbuffer
+ */
+static Py_ssize_t
+Buffer_getreadbuffer(Buffer *self, Py_ssize_t segment, void **ptr)
+{
+	if (segment != 0) {
+		PyErr_SetString(PyExc_SystemError, "Accessing non-existent segment");
+		return -1;
+	}
+
+	*ptr = self->data;
+	return self->len;
+}
+/* }}} */
+/* {{{ Buffer_getwritebuffer
+ */
+static Py_ssize_t
+Buffer_getwritebuffer(Buffer *self, Py_ssize_t segment, void **ptr)
+{
+	if (self->readonly) {
+		PyErr_SetString(PyExc_TypeError, "Buffer is read-only");
+		return -1;
+	}
+
+	return Buffer_getreadbuffer(self, segment, ptr);
+}
+/* }}} */
+/* {{{ Buffer_getsegcount
+ */
+static Py_ssize_t
+Buffer_getsegcount(Buffer *self, Py_ssize_t *lenp)
+{
+	if (lenp)
+		*lenp = self->len;
+
+	return 1;
+}
+/* }}} */
+#if PY_VERSION_HEX >= 0x02060000
+/* {{{ Buffer_getbuffer
+ */
+static int
+Buffer_getbuffer(Buffer *self, Py_buffer *view, int flags)
+{
+	if ((flags & PyBUF_WRITABLE) && self->readonly) {
+		PyErr_SetString(PyExc_BufferError, "Buffer is read-only");
+		return -1;
+	}
+
+	/*
+	 * Our storage is always a one-dimensional, C-contiguous array, so we
+	 * can satisfy any request.  The shape and strides point back into our
+	 * own structure, which outlives the view because the view holds a
+	 * reference to us.
+	 */
+	view->obj = (PyObject *)self;
+	Py_INCREF(self);
+	view->buf = self->data;
+	view->len = self->len;
+	view->readonly = self->readonly;
+	view->itemsize = self->itemsize;
+	view->format = (flags & PyBUF_FORMAT) ? self->format : NULL;
+	view->ndim = 1;
+	view->shape = (flags & PyBUF_ND) ? &self->nitems : NULL;
+	view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ?
+		&self->itemsize : NULL;
+	view->suboffsets = NULL;
+	view->internal = NULL;
+
+	return 0;
+}
+/* }}} */
+#endif
+
+/* {{{ Buffer_as_sequence
+ */
+static PySequenceMethods Buffer_as_sequence = {
+	(lenfunc)Buffer_length,								/* sq_length */
+	0,													/* sq_concat */
+	0,													/* sq_repeat */
+	(ssizeargfunc)Buffer_item,							/* sq_item */
+};
+/* }}} */
+/* {{{ Buffer_as_buffer
+ */
+static PyBufferProcs Buffer_as_buffer = {
+	(readbufferproc)Buffer_getreadbuffer,				/* bf_getreadbuffer */
+	(writebufferproc)Buffer_getwritebuffer,				/* bf_getwritebuffer */
+	(segcountproc)Buffer_getsegcount,					/* bf_getsegcount */
+	0,													/* bf_getcharbuffer */
+#if PY_VERSION_HEX >= 0x02060000
+	(getbufferproc)Buffer_getbuffer,					/* bf_getbuffer */
+	0,													/* bf_releasebuffer */
+#endif
+};
+/* }}} */
+/* {{{ Buffer_Type
+ */
+static PyTypeObject Buffer_Type = {
+	PyObject_HEAD_INIT(NULL)
+	0,													/* ob_size */
+	"php.Buffer",										/* tp_name */
+	sizeof(Buffer),										/* tp_basicsize */
+	0,													/* tp_itemsize */
+	(destructor)Buffer_dealloc,							/* tp_dealloc */
+	0,													/* tp_print */
+	0,													/* tp_getattr */
+	0,													/* tp_setattr */
+	0,													/* tp_compare */
+	0,													/* tp_repr */
+	0,													/* tp_as_number */
+	&Buffer_as_sequence,								/* tp_as_sequence */
+	0,													/* tp_as_mapping */
+	0,													/* tp_hash */
+	0,													/* tp_call */
+	0,													/* tp_str */
+	0,													/* tp_getattro */
+	0,													/* tp_setattro */
+	&Buffer_as_buffer,									/* tp_as_buffer */
+#if PY_VERSION_HEX >= 0x02060000
+	Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER,		/* tp_flags */
+#else
+	Py_TPFLAGS_DEFAULT,									/* tp_flags */
+#endif
+	"PHP Buffer",										/* tp_doc */
+};
+/* }}} */
+/* }}} */
+
+/* {{{ buffer_new(char format, Py_ssize_t itemsize, Py_ssize_t nitems)
+   Allocate a new, writable Buffer object with room for nitems items. */
+static Buffer *
+buffer_new(char format, Py_ssize_t itemsize, Py_ssize_t nitems)
+{
+	Buffer *buffer;
+
+	buffer = PyObject_New(Buffer, &Buffer_Type);
+	if (buffer == NULL)
+		return NULL;
+
+	/* Always allocate at least one byte so that data is never NULL. */
+	buffer->data = PyMem_Malloc(nitems ? nitems * itemsize : 1);
+	if (buffer->data == NULL) {
+		PyObject_Del(buffer);
+		PyErr_NoMemory();
+		return NULL;
+	}
+
+	buffer->len = nitems * itemsize;
+	buffer->nitems = nitems;
+	buffer->itemsize = itemsize;
+	buffer->format[0] = format;
+	buffer->format[1] = '\0';
+	buffer->readonly = 0;
+	buffer->owner = NULL;
+
+	return buffer;
+}
+/* }}} */
+
+/* {{{ python_buffer_wrap(zval *zv TSRMLS_DC)
+   Expose the bytes of a PHP string as a new read-only Buffer without
+   copying them.  Returns a new reference. */
+PyObject *
+python_buffer_wrap(zval *zv TSRMLS_DC)
+{
+	Buffer *buffer;
+
+	PHP_PYTHON_THREAD_ASSERT();
+
+	assert(Z_TYPE_P(zv) == IS_STRING);
+
+	buffer = PyObject_New(Buffer, &Buffer_Type);
+	if (buffer == NULL)
+		return NULL;
+
+	/*
+	 * The buffer holds a reference on the zval for as long as it lives.
+	 * PHP's copy-on-write semantics guarantee that the string's bytes won't
+	 * change underneath us: any write to a shared zval separates it first.
+	 * The one exception is a reference, whose writes happen in place, so we
+	 * take a private copy in that case.
+	 */
+	if (PZVAL_IS_REF(zv)) {
+		MAKE_STD_ZVAL(buffer->owner);
+		*buffer->owner = *zv;
+		zval_copy_ctor(buffer->owner);
+		INIT_PZVAL(buffer->owner);
+	} else {
+		Z_ADDREF_P(zv);
+		buffer->owner = zv;
+	}
+
+	buffer->data = Z_STRVAL_P(buffer->owner);
+	buffer->len = Z_STRLEN_P(buffer->owner);
+	buffer->nitems = buffer->len;
+	buffer->itemsize = 1;
+	buffer->format[0] = 'B';
+	buffer->format[1] = '\0';
+	buffer->readonly = 1;
+
+	return (PyObject *)buffer;
+}
+/* }}} */
+
+/* {{{ python_buffer_pack(HashTable *ht, char format TSRMLS_DC)
+   Pack the values of a PHP hash into a new Buffer of C doubles ('d') or C
+   longs ('l').  Returns a new reference. */
+PyObject *
+python_buffer_pack(HashTable *ht, char format TSRMLS_DC)
+{
+	Buffer *buffer;
+	HashPosition pos;
+	zval **entry, tmp;
+	Py_ssize_t i = 0;
+
+	PHP_PYTHON_THREAD_ASSERT();
+
+	assert(format == 'd' || format == 'l');
+
+	buffer = buffer_new(format,
+						(format == 'd') ? sizeof(double) : sizeof(long),
+						zend_hash_num_elements(ht));
+	if (buffer == NULL)
+		return NULL;
+
+	/*
+	 * Values that already have the requested type are stored directly.
+	 * Anything else is converted on a temporary copy, using PHP's own
+	 * conversion rules, so that the array itself is left untouched.
+	 */
+	zend_hash_internal_pointer_reset_ex(ht, &pos);
+	while (zend_hash_get_current_data_ex(ht, (void **)&entry,
+										 &pos) == SUCCESS) {
+		if (format == 'd') {
+			double *items = (double *)buffer->data;
+
+			if (Z_TYPE_PP(entry) == IS_DOUBLE)
+				items[i++] = Z_DVAL_PP(entry);
+			else if (Z_TYPE_PP(entry) == IS_LONG)
+				items[i++] = (double)Z_LVAL_PP(entry);
+			else {
+				tmp = **entry;
+				zval_copy_ctor(&tmp);
+				convert_to_double(&tmp);
+				items[i++] = Z_DVAL(tmp);
+			}
+		} else {
+			long *items = (long *)buffer->data;
+
+			if (Z_TYPE_PP(entry) == IS_LONG)
+				items[i++] = Z_LVAL_PP(entry);
+			else {
+				tmp = **entry;
+				zval_copy_ctor(&tmp);
+				convert_to_long(&tmp);
+				items[i++] = Z_LVAL(tmp);
+			}
+		}
+
+		zend_hash_move_forward_ex(ht, &pos);
+	}
+
+	return (PyObject *)buffer;
+}
+/* }}} */
+/* {{{ unpack_items(const char *data, Py_ssize_t n, char format, zval *zv TSRMLS_DC)
+   Append n items of the given format to the PHP array zv. */
+static int
+unpack_items(const char *data, Py_ssize_t n, char format, zval *zv TSRMLS_DC)
+{
+	Py_ssize_t i;
+
+#define UNPACK_LONGS(type) \
+	for (i = 0; i < n; ++i) \
+		add_next_index_long(zv, (long)((const type *)data)[i]); \
+	break
+
+#define UNPACK_DOUBLES(type) \
+	for (i = 0; i < n; ++i) \
+		add_next_index_double(zv, (double)((const type *)data)[i]); \
+	break
+
+	switch (format) {
+		case 'd': UNPACK_DOUBLES(double);
+		case 'f': UNPACK_DOUBLES(float);
+		case 'b': UNPACK_LONGS(signed char);
+		case 'B': UNPACK_LONGS(unsigned char);
+		case 'c': UNPACK_LONGS(unsigned char);
+		case 'h': UNPACK_LONGS(short);
+		case 'H': UNPACK_LONGS(unsigned short);
+		case 'i': UNPACK_LONGS(int);
+		case 'I': UNPACK_LONGS(unsigned int);
+		case 'l': UNPACK_LONGS(long);
+		case 'L': UNPACK_LONGS(unsigned long);
+		default:
+			return FAILURE;
+	}
+
+#undef UNPACK_LONGS
+#undef UNPACK_DOUBLES
+
+	return SUCCESS;
+}
+/* }}} */
+/* {{{ item_size(char format)
+   Returns the native size of an item of the given format, or 0. */
+static Py_ssize_t
+item_size(char format)
+{
+	switch (format) {
+		case 'd': return sizeof(double);
+		case 'f': return sizeof(float);
+		case 'b': case 'B': case 'c': return sizeof(char);
+		case 'h': case 'H': return sizeof(short);
+		case 'i': case 'I': return sizeof(int);
+		case 'l': case 'L': return sizeof(long);
+	}
+
+	return 0;
+}
+/* }}} */
+/* {{{ python_buffer_unpack(PyObject *o, zval *zv TSRMLS_DC)
+   Unpack the contents of a buffer-providing Python object into a packed PHP
+   array of longs or doubles. */
+int
+python_buffer_unpack(PyObject *o, zval *zv TSRMLS_DC)
+{
+	const char *data;
+	Py_ssize_t len, itemsize;
+	char format = 'B';
+	int status;
+
+	PHP_PYTHON_THREAD_ASSERT();
+
+	/* Our own buffers already know everything about their contents. */
+	if (PyObject_TypeCheck(o, &Buffer_Type)) {
+		Buffer *buffer = (Buffer *)o;
+
+		array_init_size(zv, buffer->nitems);
+		return unpack_items(buffer->data, buffer->nitems, buffer->format[0],
+							zv TSRMLS_CC);
+	}
+
+#if PY_VERSION_HEX >= 0x02060000
+	/*
+	 * Objects that implement the new buffer protocol (numpy arrays, for
+	 * example) describe their item format themselves.  We only accept
+	 * C-contiguous data using native item sizes.
+	 */
+	if (PyObject_CheckBuffer(o)) {
+		Py_buffer view;
+		const char *fmt;
+
+		if (PyObject_GetBuffer(o, &view,
+							   PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) == -1)
+			return FAILURE;
+
+		fmt = view.format ? view.format : "B";
+		if (*fmt == '@')
+			++fmt;
+
+		if (fmt[0] == '\0' || fmt[1] != '\0' ||
+			item_size(fmt[0]) != view.itemsize) {
+			PyErr_Format(PyExc_TypeError, "Unsupported buffer format '%s'",
+						 view.format ? view.format : "B");
+			PyBuffer_Release(&view);
+			return FAILURE;
+		}
+
+		array_init_size(zv, view.len / view.itemsize);
+		status = unpack_items(view.buf, view.len / view.itemsize, fmt[0],
+							  zv TSRMLS_CC);
+		PyBuffer_Release(&view);
+
+		return status;
+	}
+#endif
+
+	/*
+	 * Fall back to the classic buffer protocol.  It doesn't carry any type
+	 * information, so we honor a 'typecode' attribute (as provided by
+	 * array.array) and treat everything else as a sequence of bytes.
+	 */
+	if (PyObject_AsReadBuffer(o, (const void **)&data, &len) == -1)
+		return FAILURE;
+
+	if (PyObject_HasAttrString(o, "typecode")) {
+		PyObject *typecode = PyObject_GetAttrString(o, "typecode");
+
+		if (typecode && PyString_Check(typecode) &&
+			PyString_GET_SIZE(typecode) == 1)
+			format = PyString_AS_STRING(typecode)[0];
+		Py_XDECREF(typecode);
+	}
+
+	itemsize = item_size(format);
+	if (itemsize == 0) {
+		PyErr_Format(PyExc_TypeError, "Unsupported buffer format '%c'", format);
+		return FAILURE;
+	}
+
+	array_init_size(zv, len / itemsize);
+	return unpack_items(data, len / itemsize, format, zv TSRMLS_CC);
+}
+/* }}} */
+
+/* {{{ int python_buffer_init()
+   Initialize the Python buffer interface. */
+int
+python_buffer_init()
+{
+	if (PyType_Ready(&Buffer_Type) == -1)
+		return FAILURE;
+
+	return SUCCESS;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * tab-width: 4
+ * End:
+ * vim600: fdm=marker
+ * vim: sw=4 ts=4 noet
+ */
@@ -0,0 +1,789 @@
+/*
+ * Python in PHP - Embedded Python Extension
+ *
+ * Copyright (c) 2003,2004,2005,2006,2007,2008 Jon Parise <jon@php.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * $Id$
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "php_ini.h"
+#include "php_python_internal.h"
+#include "marshal.h"
+
+ZEND_EXTERN_MODULE_GLOBALS(python);
+
+/* {{{ code_cache_dtor(void *entry)
+   Release the code cache's reference to a compiled code object. */
+static void
+code_cache_dtor(void *entry)
+{
+	Py_DECREF(*(PyObject **)entry);
+}
+/* }}} */
+/* {{{ python_code_cache_init(TSRMLS_D)
+   Initialize this request's compiled code cache. */
+void
+python_code_cache_init(TSRMLS_D)
+{
+	zend_hash_init(&PYG(code_cache), 16, NULL, code_cache_dtor, 0);
+}
+/* }}} */
+/* {{{ python_code_cache_destroy(TSRMLS_D)
+   Destroy this request's compiled code cache.  The thread state must be
+   held because destroying the cache releases Python objects. */
+void
+python_code_cache_destroy(TSRMLS_D)
+{
+	PHP_PYTHON_THREAD_ASSERT();
+
+	zend_hash_destroy(&PYG(code_cache));
+}
+/* }}} */
+/* {{{ python_code_compile(const char *source, int len, int start TSRMLS_DC)
+   Compile a string of Python source code using the given start symbol
+   (Py_eval_input or Py_file_input).  Returns a new reference to the code
+   object, or NULL with a Python exception set. */
+PyObject *
+python_code_compile(const char *source, int len, int start TSRMLS_DC)
+{
+	HashTable *cache = &PYG(code_cache);
+	PyObject **entry, *code;
+	long size;
+	char *key;
+	int key_len;
+
+	PHP_PYTHON_THREAD_ASSERT();
+
+	/*
+	 * The cache key is the source code prefixed by the start symbol, so the
+	 * same string compiled as an expression and as a module are kept apart.
+	 */
+	key_len = len + 1;
+	key = emalloc(key_len);
+	key[0] = (char)start;
+	memcpy(key + 1, source, len);
+
+	size = INI_INT("python.code_cache_size");
+	if (size > 0 &&
+		zend_hash_find(cache, key, key_len, (void **)&entry) == SUCCESS) {
+		code = *entry;
+		Py_INCREF(code);
+
+		/*
+		 * The hashtable preserves insertion order, which we use as our
+		 * recency order.  Move this entry to the end of the list so that it
+		 * is the last candidate for eviction.
+		 */
+		if (cache->pListTail->pData != (void *)entry) {
+			Py_INCREF(code);
+			zend_hash_del(cache, key, key_len);
+			zend_hash_add(cache, key, key_len, (void *)&code,
+						  sizeof(PyObject *), NULL);
+		}
+
+		efree(key);
+		PYG(code_cache_hits)++;
+
+		return code;
+	}
+
+	if (size > 0)
+		PYG(code_cache_misses)++;
+
+	/*
+	 * Before compiling the source ourselves, check whether another process
+	 * has already compiled it and published it to the shared code cache.
+	 */
+	code = python_shm_fetch(key, key_len);
+	if (code == NULL) {
+		code = Py_CompileString(source, "<string>", start);
+		if (code == NULL) {
+			efree(key);
+			return NULL;
+		}
+
+		python_shm_store(key, key_len, code);
+	}
+
+	if (size > 0) {
+		/* Evict the least recently used entries to make room for this one. */
+		while (zend_hash_num_elements(cache) >= (uint)size) {
+			Bucket *oldest = cache->pListHead;
+			zend_hash_del(cache, oldest->arKey, oldest->nKeyLength);
+		}
+
+		Py_INCREF(code);
+		if (zend_hash_add(cache, key, key_len, (void *)&code,
+						  sizeof(PyObject *), NULL) == FAILURE)
+			Py_DECREF(code);
+	}
+
+	efree(key);
+
+	return code;
+}
+/* }}} */
+
+/*
+ * Compiled files are cached for the lifetime of the process.  Code objects
+ * belong to the request's sub-interpreter, so the cache holds their
+ * marshalled form in persistent memory instead, which is unmarshalled into
+ * each request that runs the file.  The cache is only ever accessed while
+ * holding Python's global interpreter lock, which also serializes access to
+ * it across threads.
+ */
+
+/* {{{ python_file_entry
+ */
+typedef struct _python_file_entry {
+	time_t				mtime;
+	size_t				size;
+	char *				data;			/* marshalled code object */
+	size_t				len;
+} python_file_entry;
+/* }}} */
+
+static HashTable python_file_cache;
+
+/* {{{ file_cache_dtor(void *entry)
+ */
+static void
+file_cache_dtor(void *entry)
+{
+	pefree(((python_file_entry *)entry)->data, 1);
+}
+/* }}} */
+/* {{{ python_file_cache_init()
+   Initialize the process-wide compiled file cache. */
+void
+python_file_cache_init()
+{
+	zend_hash_init(&python_file_cache, 16, NULL, file_cache_dtor, 1);
+}
+/* }}} */
+/* {{{ python_file_cache_destroy()
+   Destroy the process-wide compiled file cache. */
+void
+python_file_cache_destroy()
+{
+	zend_hash_destroy(&python_file_cache);
+}
+/* }}} */
+/* {{{ file_read(const char *filename, size_t *len, int options TSRMLS_DC)
+   Read a file's entire contents through PHP's stream layer.  Returns an
+   emalloc'ed, NUL-terminated buffer or NULL if the file can't be read. */
+static char *
+file_read(const char *filename, size_t *len, int options TSRMLS_DC)
+{
+	php_stream *stream;
+	char *buf = NULL;
+
+	stream = php_stream_open_wrapper((char *)filename, "rb",
+									 options | ENFORCE_SAFE_MODE, NULL);
+	if (stream == NULL)
+		return NULL;
+
+	*len = php_stream_copy_to_mem(stream, &buf, PHP_STREAM_COPY_ALL, 0);
+	php_stream_close(stream);
+
+	/* An empty file is still valid Python code. */
+	if (buf == NULL)
+		buf = estrndup("", 0);
+
+	return buf;
+}
+/* }}} */
+/* {{{ file_read_compiled(const char *filename, time_t mtime TSRMLS_DC)
+   Read the marshalled code object from the .pyc (or .pyo) file that goes
+   with the given source file, as long as it was compiled by this version of
+   Python from a source file with the given modification time.  Returns a
+   new string reference or NULL, without setting a Python exception. */
+static PyObject *
+file_read_compiled(const char *filename, time_t mtime TSRMLS_DC)
+{
+	unsigned char *buf;
+	char *path;
+	size_t len, filename_len = strlen(filename);
+	long magic, pyc_mtime;
+	PyObject *data = NULL;
+
+	if (filename_len < 3 || strcmp(filename + filename_len - 3, ".py") != 0)
+		return NULL;
+
+	spprintf(&path, 0, "%s%c", filename, Py_OptimizeFlag ? 'o' : 'c');
+	buf = (unsigned char *)file_read(path, &len, 0 TSRMLS_CC);
+	efree(path);
+
+	if (buf == NULL)
+		return NULL;
+
+	/* The header holds the magic number and source mtime, little-endian. */
+	if (len > 8) {
+		magic = buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((long)buf[3] << 24);
+		pyc_mtime = buf[4] | (buf[5] << 8) | (buf[6] << 16) |
+					((long)buf[7] << 24);
+
+		if (magic == PyImport_GetMagicNumber() &&
+			pyc_mtime == (long)(mtime & 0xFFFFFFFFL))
+			data = PyString_FromStringAndSize((char *)buf + 8, len - 8);
+	}
+
+	efree(buf);
+
+	if (data == NULL)
+		PyErr_Clear();
+
+	return data;
+}
+/* }}} */
+/* {{{ file_compile(const char *filename TSRMLS_DC)
+   Read and compile a Python source file.  Returns a new reference to the
+   code object, or NULL with a Python exception set. */
+static PyObject *
+file_compile(const char *filename TSRMLS_DC)
+{
+	PyObject *code;
+	size_t len;
+	char *source;
+
+	source = file_read(filename, &len, REPORT_ERRORS TSRMLS_CC);
+	if (source == NULL) {
+		PyErr_Format(PyExc_IOError, "Failed to open '%s'", filename);
+		return NULL;
+	}
+
+	code = Py_CompileString(source, filename, Py_file_input);
+	efree(source);
+
+	return code;
+}
+/* }}} */
+/* {{{ python_code_compile_file(const char *filename TSRMLS_DC)
+   Return the compiled code for a Python source file, using the process's
+   compiled file cache (validated against the file's modification time and
+   size), the shared code cache and any up-to-date .pyc file.  Returns a new
+   reference to the code object, or NULL with a Python exception set. */
+PyObject *
+python_code_compile_file(const char *filename TSRMLS_DC)
+{
+	python_file_entry *entry, new_entry;
+	php_stream_statbuf ssb;
+	PyObject *code, *data;
+	char *key, *shm_key;
+	int key_len, shm_key_len, shared;
+
+	PHP_PYTHON_THREAD_ASSERT();
+
+	/* Local paths are made absolute so the key doesn't depend on the cwd. */
+	key = strstr(filename, "://") ? NULL : expand_filepath(filename,
+														   NULL TSRMLS_CC);
+	if (key == NULL)
+		key = estrdup(filename);
+	key_len = strlen(key) + 1;
+
+	if (zend_hash_find(&python_file_cache, key, key_len,
+					   (void **)&entry) == FAILURE)
+		entry = NULL;
+
+	/*
+	 * Without timestamp validation, a cached entry is used as is, saving a
+	 * stat() call per run.
+	 */
+	if (entry && !INI_INT("python.validate_timestamps")) {
+		code = PyMarshal_ReadObjectFromString(entry->data, entry->len);
+		if (code) {
+			efree(key);
+			return code;
+		}
+		PyErr_Clear();
+	}
+
+	/* Files that can't be stat'ed (some wrappers) are never cached. */
+	if (php_stream_stat_path(key, &ssb) != 0) {
+		efree(key);
+		return file_compile(filename TSRMLS_CC);
+	}
+
+	if (entry && entry->mtime == ssb.sb.st_mtime &&
+		entry->size == (size_t)ssb.sb.st_size) {
+		code = PyMarshal_ReadObjectFromString(entry->data, entry->len);
+		if (code) {
+			efree(key);
+			return code;
+		}
+		PyErr_Clear();
+	}
+
+	/*
+	 * Another process may already have compiled this version of the file.
+	 * The shared cache never replaces an entry, so its key includes the
+	 * file's modification time and size.
+	 */
+	shm_key_len = spprintf(&shm_key, 0, "F%s:%ld:%ld", key,
+						   (long)ssb.sb.st_mtime, (long)ssb.sb.st_size);
+	data = NULL;
+	code = python_shm_fetch(shm_key, shm_key_len);
+	shared = (code != NULL);
+
+	/*
+	 * Otherwise, prefer the code object from an up-to-date .pyc file, or
+	 * compile the source ourselves.  Either way, the marshalled code is
+	 * cached for later runs.
+	 */
+	if (code == NULL)
+		data = file_read_compiled(key, ssb.sb.st_mtime TSRMLS_CC);
+	if (data) {
+		code = PyMarshal_ReadObjectFromString(PyString_AS_STRING(data),
+											  PyString_GET_SIZE(data));
+		if (code == NULL || !PyCode_Check(code)) {
+			Py_CLEAR(code);
+			Py_CLEAR(data);
+			PyErr_Clear();
+		}
+	}
+
+	if (code == NULL) {
+		code = file_compile(filename TSRMLS_CC);
+		if (code == NULL) {
+			efree(shm_key);
+			efree(key);
+			return NULL;
+		}
+	}
+
+	if (!shared)
+		python_shm_store(shm_key, shm_key_len, code);
+	efree(shm_key);
+
+	if (data == NULL) {
+		data = PyMarshal_WriteObjectToString(code, Py_MARSHAL_VERSION);
+		if (data == NULL)
+			PyErr_Clear();
+	}
+
+	if (data) {
+		new_entry.mtime = ssb.sb.st_mtime;
+		new_entry.size = ssb.sb.st_size;
+		new_entry.len = PyString_GET_SIZE(data);
+		new_entry.data = pemalloc(new_entry.len, 1);
+		memcpy(new_entry.data, PyString_AS_STRING(data), new_entry.len);
+
+		zend_hash_update(&python_file_cache, key, key_len, &new_entry,
+						 sizeof(python_file_entry), NULL);
+
+		Py_DECREF(data);
+	}
+
+	efree(key);
+
+	return code;
+}
+/* }}} */
+
+/*
+ * When the shared code cache is enabled, an importer on sys.meta_path loads
+ * plain source modules through python_code_compile_file(), so that imported
+ * modules are compiled once and shared between processes as well.  It finds
+ * modules with the imp module, exactly as Python's own importer does, and
+ * leaves everything else (packages, extension modules, modules outside of
+ * open_basedir, and imports made from other threads) to Python.
+ */
+
+/* {{{ Importer
+ */
+typedef struct {
+	PyObject_HEAD
+	PyObject *	filename;		/* the module's source file, for a loader */
+} Importer;
+
+static PyTypeObject Importer_Type;
+/* }}} */
+
+/* {{{ Importer_dealloc
+ */
+static void
+Importer_dealloc(Importer *self)
+{
+	Py_XDECREF(self->filename);
+	PyObject_Del(self);
+}
+/* }}} */
+/* {{{ Importer_find_module
+   Return a loader for the named module if it is a plain source module, or
+   None to let Python's own importer handle it. */
+static PyObject *
+Importer_find_module(Importer *self, PyObject *args)
+{
+	PyObject *path = Py_None, *imp, *found, *file, *filename, *source_type;
+	Importer *loader = NULL;
+	char *fullname, *name, *suffix, *mode;
+	long type;
+	TSRMLS_FETCH();
+
+	if (!PyArg_ParseTuple(args, "s|O:find_module", &fullname, &path))
+		return NULL;
+
+	/* PHP's stream layer can only be used from the request's own thread. */
+	if (PyThreadState_GET() != PYG(tstate))
+		Py_RETURN_NONE;
+
+	name = strrchr(fullname, '.');
+	name = name ? name + 1 : fullname;
+
+	imp = PyImport_ImportModule("imp");
+	if (imp == NULL)
+		return NULL;
+
+	found = PyObject_CallMethod(imp, "find_module", "sO", name, path);
+	if (found == NULL) {
+		Py_DECREF(imp);
+		if (!PyErr_ExceptionMatches(PyExc_ImportError))
+			return NULL;
+		PyErr_Clear();
+		Py_RETURN_NONE;
+	}
+
+	if (!PyArg_ParseTuple(found, "OS(ssl)", &file, &filename, &suffix, &mode,
+						  &type))
+		goto cleanup;
+
+	if (file != Py_None) {
+		PyObject *result = PyObject_CallMethod(file, "close", NULL);
+		if (result == NULL)
+			goto cleanup;
+		Py_DECREF(result);
+	}
+
+	source_type = PyObject_GetAttrString(imp, "PY_SOURCE");
+	if (source_type == NULL)
+		goto cleanup;
+
+	if (type == PyInt_AsLong(source_type) &&
+		!(PG(open_basedir) && *PG(open_basedir) &&
+		  php_check_open_basedir_ex(PyString_AS_STRING(filename), 0 TSRMLS_CC) != 0)) {
+		loader = PyObject_New(Importer, &Importer_Type);
+		if (loader) {
+			Py_INCREF(filename);
+			loader->filename = filename;
+		}
+	} else {
+		Py_INCREF(Py_None);
+		loader = (Importer *)Py_None;
+	}
+
+	Py_DECREF(source_type);
+
+cleanup:
+	Py_DECREF(found);
+	Py_DECREF(imp);
+
+	return (PyObject *)loader;
+}
+/* }}} */
+/* {{{ Importer_load_module
+   Load the module this loader was found for. */
+static PyObject *
+Importer_load_module(Importer *self, PyObject *args)
+{
+	PyObject *code, *module;
+	char *fullname;
+	TSRMLS_FETCH();
+
+	if (!PyArg_ParseTuple(args, "s:load_module", &fullname))
+		return NULL;
+
+	if (self->filename == NULL) {
+		PyErr_Format(PyExc_ImportError, "No module named %s", fullname);
+		return NULL;
+	}
+
+	code = python_code_compile_file(PyString_AS_STRING(self->filename) TSRMLS_CC);
+	if (code == NULL)
+		return NULL;
+
+	module = PyImport_ExecCodeModuleEx(fullname, code,
+									   PyString_AS_STRING(self->filename));
+	Py_DECREF(code);
+
+	return module;
+}
+/* }}} */
+
+/* {{{ Importer_methods
+ */
+static PyMethodDef Importer_methods[] = {
+	{ "find_module",	(PyCFunction)Importer_find_module,	METH_VARARGS, 0 },
+	{ "load_module",	(PyCFunction)Importer_load_module,	METH_VARARGS, 0 },
+	{ NULL, NULL}
+};
+/* }}} */
+/* {{{ Importer_Type
+ */
+static PyTypeObject Importer_Type = {
+	PyObject_HEAD_INIT(NULL)
+	0,													/* ob_size */
+	"php.Importer",										/* tp_name */
+	sizeof(Importer),									/* tp_basicsize */
+	0,													/* tp_itemsize */
+	(destructor)Importer_dealloc,						/* tp_dealloc */
+	0,													/* tp_print */
+	0,													/* tp_getattr */
+	0,													/* tp_setattr */
+	0,													/* tp_compare */
+	0,													/* tp_repr */
+	0,													/* tp_as_number */
+	0,													/* tp_as_sequence */
+	0,													/* tp_as_mapping */
+	0,													/* tp_hash */
+	0,													/* tp_call */
+	0,													/* tp_str */
+	0,													/* tp_getattro */
+	0,													/* tp_setattro */
+	0,													/* tp_as_buffer */
+	Py_TPFLAGS_DEFAULT,									/* tp_flags */
+	"PHP Shared Code Cache Importer",					/* tp_doc */
+	0,													/* tp_traverse */
+	0,													/* tp_clear */
+	0,													/* tp_richcompare */
+	0,													/* tp_weaklistoffset */
+	0,													/* tp_iter */
+	0,													/* tp_iternext */
+	Importer_methods,									/* tp_methods */
+};
+/* }}} */
+
+/* {{{ python_code_importer_install(TSRMLS_D)
+   Add the shared code cache's importer to sys.meta_path if the cache is
+   enabled. */
+int
+python_code_importer_install(TSRMLS_D)
+{
+	PyObject *meta_path;
+	Importer *finder;
+	size_t size, used;
+	ulong count;
+	int status;
+
+	if (python_shm_info(&size, &used, &count) == FAILURE)
+		return SUCCESS;
+
+	if (PyType_Ready(&Importer_Type) == -1)
+		return FAILURE;
+
+	meta_path = PySys_GetObject("meta_path");
+	if (meta_path == NULL || !PyList_Check(meta_path))
+		return FAILURE;
+
+	finder = PyObject_New(Importer, &Importer_Type);
+	if (finder == NULL)
+		return FAILURE;
+
+	finder->filename = NULL;
+	status = PyList_Append(meta_path, (PyObject *)finder);
+	Py_DECREF(finder);
+
+	return (status == 0) ? SUCCESS : FAILURE;
+}
+/* }}} */
+
+/* {{{ php_python_code
+ */
+typedef struct _php_python_code {
+	zend_object			base;
+	PyObject *			code;
+	int					start;
+} php_python_code;
+/* }}} */
+
+zend_class_entry *python_code_class_entry;
+static zend_object_handlers python_code_handlers;
+
+/* {{{ python_code_destroy(void *object, zend_object_handle handle TSRMLS_DC)
+ */
+static void
+python_code_destroy(void *object, zend_object_handle handle TSRMLS_DC)
+{
+	php_python_code *pc = (php_python_code *)object;
+
+	if (pc->code) {
+		PHP_PYTHON_THREAD_ACQUIRE();
+		Py_DECREF(pc->code);
+		PHP_PYTHON_THREAD_RELEASE();
+	}
+
+	zend_object_std_dtor(&pc->base TSRMLS_CC);
+}
+/* }}} */
+/* {{{ python_code_free(void *object TSRMLS_DC)
+ */
+static void
+python_code_free(void *object TSRMLS_DC)
+{
+	efree(object);
+}
+/* }}} */
+/* {{{ python_code_create(zend_class_entry *ce TSRMLS_DC)
+ */
+static zend_object_value
+python_code_create(zend_class_entry *ce TSRMLS_DC)
+{
+	zval *tmp;
+	php_python_code *pc;
+	zend_object_value retval;
+
+	pc = emalloc(sizeof(php_python_code));
+	memset(&pc->base, 0, sizeof(zend_object));
+	pc->code = NULL;
+	pc->start = Py_file_input;
+
+	zend_object_std_init(&pc->base, ce TSRMLS_CC);
+	zend_hash_copy(pc->base.properties, &ce->default_properties,
+				   (copy_ctor_func_t)zval_add_ref,
+				   (void *) &tmp, sizeof(zval *));
+
+	retval.handle = zend_objects_store_put(pc, python_code_destroy,
+										   python_code_free, NULL TSRMLS_CC);
+	retval.handlers = &python_code_handlers;
+
+	return retval;
+}
+/* }}} */
+/* {{{ python_code_wrap(PyObject *code, int start, zval *zv TSRMLS_DC)
+   Initialize zv as a PythonCode object holding the given code object.  The
+   caller's reference to the code object is stolen. */
+int
+python_code_wrap(PyObject *code, int start, zval *zv TSRMLS_DC)
+{
+	php_python_code *pc;
+
+	if (object_init_ex(zv, python_code_class_entry) != SUCCESS) {
+		Py_DECREF(code);
+		return FAILURE;
+	}
+
+	pc = (php_python_code *)zend_object_store_get_object(zv TSRMLS_CC);
+	pc->code = code;
+	pc->start = start;
+
+	return SUCCESS;
+}
+/* }}} */
+
+/* {{{ proto mixed PythonCode::run([array variables])
+   Run the compiled code in a new namespace seeded with the given variables.
+   Code compiled in 'eval' mode returns the value of its expression; code
+   compiled in 'exec' mode returns true on success. */
+PHP_METHOD(PythonCode, run)
+{
+	php_python_code *pc;
+	zval *vars = NULL;
+	PyObject *d, *v;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|a",
+							  &vars) == FAILURE) {
+		return;
+	}
+
+	pc = (php_python_code *)zend_object_store_get_object(getThis() TSRMLS_CC);
+	if (pc->code == NULL) {
+		php_error(E_WARNING, "Python: PythonCode object is not initialized");
+		RETURN_FALSE;
+	}
+
+	PHP_PYTHON_THREAD_ACQUIRE();
+
+	/*
+	 * Each run gets its own namespace, used for both globals and locals, so
+	 * that bound variables never leak between runs or into __main__.
+	 */
+	d = vars ? pip_hash_to_dict(vars TSRMLS_CC) : PyDict_New();
+	if (d == NULL) {
+		python_error(E_WARNING TSRMLS_CC);
+		PHP_PYTHON_THREAD_RELEASE();
+		RETURN_FALSE;
+	}
+
+	if (PyDict_GetItemString(d, "__builtins__") == NULL)
+		PyDict_SetItemString(d, "__builtins__", PyEval_GetBuiltins());
+
+	v = PyEval_EvalCode((PyCodeObject *)pc->code, d, d);
+	Py_DECREF(d);
+
+	if (v == NULL) {
+		python_error(E_WARNING TSRMLS_CC);
+		PHP_PYTHON_THREAD_RELEASE();
+		RETURN_FALSE;
+	}
+
+	if (pc->start == Py_eval_input) {
+		if (pip_pyobject_to_zval(v, return_value TSRMLS_CC) == FAILURE)
+			ZVAL_NULL(return_value);
+	} else
+		RETVAL_TRUE;
+
+	Py_DECREF(v);
+
+	PHP_PYTHON_THREAD_RELEASE();
+}
+/* }}} */
+
+/* {{{ python_code_methods[]
+ */
+static zend_function_entry python_code_methods[] = {
+	PHP_ME(PythonCode, run, NULL, ZEND_ACC_PUBLIC)
+	{NULL, NULL, NULL}
+};
+/* }}} */
+
+/* {{{ python_code_init(TSRMLS_D)
+   Register the PythonCode class. */
+int
+python_code_init(TSRMLS_D)
+{
+	zend_class_entry ce;
+
+	INIT_CLASS_ENTRY(ce, "PythonCode", python_code_methods);
+	python_code_class_entry = zend_register_internal_class(&ce TSRMLS_CC);
+	python_code_class_entry->create_object = python_code_create;
+	python_code_class_entry->ce_flags |= ZEND_ACC_FINAL_CLASS;
+
+	memcpy(&python_code_handlers, zend_get_std_object_handlers(),
+		   sizeof(zend_object_handlers));
+	python_code_handlers.clone_obj = NULL;
+
+	return SUCCESS;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * tab-width: 4
+ * End:
+ * vim600: fdm=marker
+ * vim: sw=4 ts=4 noet
+ */
@@ -25,11 +25,90 @@
  */
 
 #include "php.h"
+#include "zend_closures.h"
 #include "php_python_internal.h"
 
 ZEND_EXTERN_MODULE_GLOBALS(python);
 extern zend_class_entry *python_class_entry;
 
+/*
+ * Upper bound on the number of distinct string keys remembered by the
+ * per-request key cache.  Keys beyond this limit are still converted; they
+ * just aren't cached.
+ */
+#define PIP_KEY_CACHE_SIZE 1024
+
+/* Key Cache */
+
+/* {{{ pip_key_cache_dtor(void *entry)
+   Release the key cache's reference to a cached Python string. */
+static void
+pip_key_cache_dtor(void *entry)
+{
+	Py_DECREF(*(PyObject **)entry);
+}
+/* }}} */
+/* {{{ pip_key_cache_init(TSRMLS_D)
+   Initialize this request's key cache. */
+void
+pip_key_cache_init(TSRMLS_D)
+{
+	zend_hash_init(&PYG(key_cache), 32, NULL, pip_key_cache_dtor, 0);
+}
+/* }}} */
+/* {{{ pip_key_cache_destroy(TSRMLS_D)
+   Destroy this request's key cache.  The thread state must be held. */
+void
+pip_key_cache_destroy(TSRMLS_D)
+{
+	PHP_PYTHON_THREAD_ASSERT();
+
+	zend_hash_destroy(&PYG(key_cache));
+}
+/* }}} */
+/* {{{ pip_key_to_pyobject(char *key, uint key_len, ulong h TSRMLS_DC)
+   Return a new reference to an interned Python string for the given PHP
+   hash key.  key_len includes the terminating NUL, as it does in the hash. */
+static PyObject *
+pip_key_to_pyobject(char *key, uint key_len, ulong h TSRMLS_DC)
+{
+	PyObject **entry, *str;
+
+	PHP_PYTHON_THREAD_ASSERT();
+
+	/*
+	 * Arrays of records tend to repeat the same handful of keys over and
+	 * over again.  The key's hash value has already been computed by the
+	 * source hashtable, so a cache hit costs us a single bucket lookup.
+	 */
+	if (zend_hash_quick_find(&PYG(key_cache), key, key_len, h,
+							 (void **)&entry) == SUCCESS) {
+		Py_INCREF(*entry);
+		return *entry;
+	}
+
+	/*
+	 * Interned strings carry their own cached hash value and compare by
+	 * identity, which also makes the Python-side dictionary operations on
+	 * these keys cheaper.
+	 */
+	str = PyString_FromStringAndSize(key, key_len - 1);
+	if (str == NULL)
+		return NULL;
+	PyString_InternInPlace(&str);
+
+	if (zend_hash_num_elements(&PYG(key_cache)) < PIP_KEY_CACHE_SIZE) {
+		Py_INCREF(str);
+		if (zend_hash_quick_add(&PYG(key_cache), key, key_len, h,
+								(void *)&str, sizeof(PyObject *),
+								NULL) == FAILURE)
+			Py_DECREF(str);
+	}
+
+	return str;
+}
+/* }}} */
+
 /* PHP to Python Conversions */
 
 /* {{{ pip_hash_to_list(zval *hash TSRMLS_DC)
@@ -83,10 +162,12 @@ pip_hash_to_tuple(zval *hash TSRMLS_DC)
 PyObject *
 pip_hash_to_dict(zval *hash TSRMLS_DC)
 {
-	PyObject *dict, *integer;
+	PyObject *dict, *key;
+	HashPosition pos;
 	zval **entry;
 	char *string_key;
-	long num_key;
+	uint string_key_len;
+	ulong num_key;
 
 	PHP_PYTHON_THREAD_ASSERT();
 
@@ -98,31 +179,42 @@ pip_hash_to_dict(zval *hash TSRMLS_DC)
 	/* Create a new empty dictionary. */
 	dict = PyDict_New();
 
-	/* Let's start at the very beginning, a very good place to start. */
-	zend_hash_internal_pointer_reset(Z_ARRVAL_P(hash));
+	/*
+	 * Let's start at the very beginning, a very good place to start.  We
+	 * use an external position so that we have access to each bucket's
+	 * precomputed hash value (and leave the array's internal pointer alone).
+	 */
+	zend_hash_internal_pointer_reset_ex(Z_ARRVAL_P(hash), &pos);
 
 	/* Iterate over the hash's elements. */
-	while (zend_hash_get_current_data(Z_ARRVAL_P(hash),
-									  (void **)&entry) == SUCCESS) {
+	while (zend_hash_get_current_data_ex(Z_ARRVAL_P(hash),
+										 (void **)&entry, &pos) == SUCCESS) {
 
 		/* Convert the PHP value to its Python equivalent (recursion). */
 		PyObject *item = pip_zval_to_pyobject(*entry TSRMLS_CC);
 
 		/* Assign the item with the appropriate key type (string or integer). */
-		switch (zend_hash_get_current_key(Z_ARRVAL_P(hash), &string_key,
-										  &num_key, 0)) {
+		key = NULL;
+		switch (zend_hash_get_current_key_ex(Z_ARRVAL_P(hash), &string_key,
+											 &string_key_len, &num_key, 0,
+											 &pos)) {
 			case HASH_KEY_IS_STRING:
-				PyDict_SetItemString(dict, string_key, item);
+				key = pip_key_to_pyobject(string_key, string_key_len,
+										  pos->h TSRMLS_CC);
 				break;
 			case HASH_KEY_IS_LONG:
-				integer = PyInt_FromLong(num_key);
-				PyDict_SetItem(dict, integer, item);
-				Py_DECREF(integer);
+				key = PyInt_FromLong(num_key);
 				break;
 		}
 
+		if (key && item)
+			PyDict_SetItem(dict, key, item);
+
+		Py_XDECREF(key);
+		Py_XDECREF(item);
+
 		/* Advance to the next entry. */
-		zend_hash_move_forward(Z_ARRVAL_P(hash));
+		zend_hash_move_forward_ex(Z_ARRVAL_P(hash), &pos);
 	}
 
 	return dict;
@@ -133,10 +225,12 @@ pip_hash_to_dict(zval *hash TSRMLS_DC)
 PyObject *
 pip_zobject_to_pyobject(zval *obj TSRMLS_DC)
 {
-	PyObject *dict, *str;
+	PyObject *dict, *key;
+	HashPosition pos;
 	zval **entry;
 	char *string_key;
-	long num_key;
+	uint string_key_len;
+	ulong num_key;
 
 	PHP_PYTHON_THREAD_ASSERT();
 
@@ -149,37 +243,69 @@ pip_zobject_to_pyobject(zval *obj TSRMLS_DC)
 	dict = PyDict_New();
 
 	/* Start at the beginning of the object properties hash */
-	zend_hash_internal_pointer_reset(Z_OBJPROP_P(obj));
+	zend_hash_internal_pointer_reset_ex(Z_OBJPROP_P(obj), &pos);
 
 	/* Iterate over the hash's elements */
-	while (zend_hash_get_current_data(Z_OBJPROP_P(obj),
-									  (void **)&entry) == SUCCESS) {
+	while (zend_hash_get_current_data_ex(Z_OBJPROP_P(obj),
+										 (void **)&entry, &pos) == SUCCESS) {
 
 		/* Convert the PHP value to its Python equivalent (recursion) */
 		PyObject *item = pip_zval_to_pyobject(*entry TSRMLS_CC);
 
-		switch (zend_hash_get_current_key(Z_OBJPROP_P(obj),
-										  &string_key, &num_key, 0)) {
+		key = NULL;
+		switch (zend_hash_get_current_key_ex(Z_OBJPROP_P(obj), &string_key,
+											 &string_key_len, &num_key, 0,
+											 &pos)) {
 			case HASH_KEY_IS_STRING:
-				PyDict_SetItemString(dict, string_key, item);
+				key = pip_key_to_pyobject(string_key, string_key_len,
+										  pos->h TSRMLS_CC);
 				break;
 			case HASH_KEY_IS_LONG:
-				str = PyString_FromFormat("%d", num_key);
-				PyObject_SetItem(dict, str, item);
-				Py_DECREF(str);
+				key = PyString_FromFormat("%lu", num_key);
 				break;
 			case HASH_KEY_NON_EXISTANT:
 				php_error(E_ERROR, "Hash key is nonexistent");
 				break;
 		}
 
+		if (key && item)
+			PyObject_SetItem(dict, key, item);
+
+		Py_XDECREF(key);
+		Py_XDECREF(item);
+
 		/* Advance to the next entry */
-		zend_hash_move_forward(Z_OBJPROP_P(obj));
+		zend_hash_move_forward_ex(Z_OBJPROP_P(obj), &pos);
 	}
 
 	return dict;
 }
 /* }}} */
+/* {{{ pip_zval_is_callable(zval *val TSRMLS_DC)
+   Decide whether a PHP array or object should be converted into a callable
+   php.Function: a Closure, an object with an __invoke() method, or an
+   array(object, method) pair naming a callable method. */
+int
+pip_zval_is_callable(zval *val TSRMLS_DC)
+{
+	zend_class_entry *ce;
+	zval **obj, **method;
+
+	if (Z_TYPE_P(val) == IS_OBJECT) {
+		ce = Z_OBJCE_P(val);
+		return ce && (ce == zend_ce_closure ||
+			zend_hash_exists(&ce->function_table, "__invoke", sizeof("__invoke")));
+	}
+
+	if (zend_hash_num_elements(Z_ARRVAL_P(val)) != 2 ||
+		zend_hash_index_find(Z_ARRVAL_P(val), 0, (void **)&obj) == FAILURE ||
+		zend_hash_index_find(Z_ARRVAL_P(val), 1, (void **)&method) == FAILURE)
+		return 0;
+
+	return Z_TYPE_PP(obj) == IS_OBJECT && Z_TYPE_PP(method) == IS_STRING &&
+		zend_is_callable(val, 0, NULL TSRMLS_CC);
+}
+/* }}} */
 /* {{{ pip_zval_to_pyobject(zval *val TSRMLS_DC)
    Converts the given zval into an equivalent PyObject. */
 PyObject *
@@ -213,15 +339,33 @@ pip_zval_to_pyobject(zval *val TSRMLS_DC)
 		break;
 #endif
 	case IS_ARRAY:
-		ret = pip_hash_to_dict(val TSRMLS_CC);
+		if (pip_zval_is_callable(val TSRMLS_CC))
+			ret = python_function_new(val TSRMLS_CC);
+		else
+			ret = pip_hash_to_dict(val TSRMLS_CC);
 		break;
 	case IS_OBJECT:
-		ret = pip_zobject_to_pyobject(val TSRMLS_CC);
+		/*
+		 * PHP objects that wrap a Python object are handed back to Python
+		 * as the original object instead of being converted.  Callable
+		 * objects become php.Function objects that call back into PHP.
+		 */
+		ret = python_object_from_zval(val TSRMLS_CC);
+		if (ret)
+			Py_INCREF(ret);
+		else if (pip_zval_is_callable(val TSRMLS_CC))
+			ret = python_function_new(val TSRMLS_CC);
+		else
+			ret = pip_zobject_to_pyobject(val TSRMLS_CC);
 		break;
 	case IS_NULL:
 		Py_INCREF(Py_None);
 		ret = Py_None;
 		break;
+	case IS_RESOURCE:
+		/* Stream resources become php.Stream file objects. */
+		ret = python_stream_from_zval(val TSRMLS_CC);
+		break;
 	default:
 		ret = NULL;
 		break;
@@ -233,10 +377,86 @@ pip_zval_to_pyobject(zval *val TSRMLS_DC)
 
 /* Python to PHP Conversions */
 
-/* {{{ pip_sequence_to_hash(PyObject *o, HashTable *ht TSRMLS_DC)
+/* {{{ pip_memo_init(HashTable *memo)
+   Initialize a conversion memo.  The memo maps Python objects (by address)
+   to the zvals that they have already been converted into. */
+void
+pip_memo_init(HashTable *memo)
+{
+	zend_hash_init(memo, 8, NULL, ZVAL_PTR_DTOR, 0);
+}
+/* }}} */
+/* {{{ pip_memo_add(HashTable *memo, PyObject *o, zval *zv)
+   Remember that the given Python object has been converted into zv. */
+void
+pip_memo_add(HashTable *memo, PyObject *o, zval *zv)
+{
+	/*
+	 * The memo holds its own reference to the zval.  Without it, a value
+	 * that is overwritten in the destination hashtable (by a subsequent
+	 * zend_hash_update(), for example) could be freed while we still have
+	 * its address on record.
+	 */
+	Z_ADDREF_P(zv);
+	zend_hash_update(memo, (char *)&o, sizeof(o), (void *)&zv,
+					 sizeof(zval *), NULL);
+}
+/* }}} */
+/* {{{ pip_memo_find(HashTable *memo, PyObject *o)
+   Return the zval previously converted from the given object, or NULL. */
+zval *
+pip_memo_find(HashTable *memo, PyObject *o)
+{
+	zval **entry;
+
+	if (zend_hash_find(memo, (char *)&o, sizeof(o), (void **)&entry) == SUCCESS)
+		return *entry;
+
+	return NULL;
+}
+/* }}} */
+/* {{{ pip_item_to_zval(PyObject *item, HashTable *memo TSRMLS_DC)
+   Convert a container item into a new zval reference. */
+static zval *
+pip_item_to_zval(PyObject *item, HashTable *memo TSRMLS_DC)
+{
+	zval *v;
+
+	PHP_PYTHON_THREAD_ASSERT();
+
+	/*
+	 * If we've already converted this exact object during the current
+	 * conversion, share the existing zval instead of creating a second PHP
+	 * object for it.  This is what keeps self-referential and heavily
+	 * shared structures from being expanded over and over again.
+	 */
+	if (memo && (v = pip_memo_find(memo, item)) != NULL) {
+		Z_ADDREF_P(v);
+		return v;
+	}
+
+	ALLOC_INIT_ZVAL(v);
+	if (pip_pyobject_to_zval(item, v TSRMLS_CC) == FAILURE) {
+		zval_ptr_dtor(&v);
+		return NULL;
+	}
+
+	/*
+	 * Only objects are worth remembering.  Scalars are cheaper to convert
+	 * than to look up, and the PHP object holds a reference to the Python
+	 * object, which keeps its address from being reused while the memo is
+	 * alive.
+	 */
+	if (memo && Z_TYPE_P(v) == IS_OBJECT)
+		pip_memo_add(memo, item, v);
+
+	return v;
+}
+/* }}} */
+/* {{{ pip_sequence_to_hash(PyObject *o, HashTable *ht, HashTable *memo TSRMLS_DC)
    Convert a Python sequence to a PHP hash. */
 int
-pip_sequence_to_hash(PyObject *o, HashTable *ht TSRMLS_DC)
+pip_sequence_to_hash(PyObject *o, HashTable *ht, HashTable *memo TSRMLS_DC)
 {
 	PyObject *item;
 	zval *v;
@@ -260,16 +480,13 @@ pip_sequence_to_hash(PyObject *o, HashTable *ht TSRMLS_DC)
 
 		/*
 		 * Attempt to convert the item from a Python object to a PHP value.
-		 * This involves allocating a new zval, testing the success of the
-		 * conversion, and potentially cleaning up the zval upon failure.
+		 * The memo may hand us back a zval that we've already produced for
+		 * this same object.
 		 */
-		MAKE_STD_ZVAL(v);
-		if (pip_pyobject_to_zval(item, v TSRMLS_CC) == FAILURE) {
-			zval_dtor(v);
-			Py_DECREF(item);
-			return FAILURE;
-		}
+		v = pip_item_to_zval(item, memo TSRMLS_CC);
 		Py_DECREF(item);
+		if (v == NULL)
+			return FAILURE;
 
 		/*
 		 * Append (i.e., insert into the next slot) the PHP value into our
@@ -277,8 +494,10 @@ pip_sequence_to_hash(PyObject *o, HashTable *ht TSRMLS_DC)
 		 * failure.
 		 */
 		if (zend_hash_next_index_insert(ht, (void *)&v, sizeof(zval *),
-										NULL) == FAILURE)
+										NULL) == FAILURE) {
+			zval_ptr_dtor(&v);
 			return FAILURE;
+		}
 	}
 
 	return SUCCESS;
@@ -289,22 +508,28 @@ pip_sequence_to_hash(PyObject *o, HashTable *ht TSRMLS_DC)
 int
 pip_sequence_to_array(PyObject *o, zval *zv TSRMLS_DC)
 {
+	HashTable memo;
+	int status = FAILURE;
+
 	PHP_PYTHON_THREAD_ASSERT();
 
 	/*
 	 * Initialize our zval as an array.  The converted sequence will be
 	 * stored in the array's hashtable.
 	 */
-	if (array_init(zv) == SUCCESS)
-		return pip_sequence_to_hash(o, Z_ARRVAL_P(zv) TSRMLS_CC);
+	if (array_init(zv) == SUCCESS) {
+		pip_memo_init(&memo);
+		status = pip_sequence_to_hash(o, Z_ARRVAL_P(zv), &memo TSRMLS_CC);
+		zend_hash_destroy(&memo);
+	}
 
-	return FAILURE;
+	return status;
 }
 /* }}} */
-/* {{{ pip_mapping_to_hash(PyObject *o, HashTable *ht TSRMLS_DC)
+/* {{{ pip_mapping_to_hash(PyObject *o, HashTable *ht, HashTable *memo TSRMLS_DC)
    Convert a Python mapping to a PHP hash. */
 int
-pip_mapping_to_hash(PyObject *o, HashTable *ht TSRMLS_DC)
+pip_mapping_to_hash(PyObject *o, HashTable *ht, HashTable *memo TSRMLS_DC)
 {
 	PyObject *keys, *key, *str, *item;
 	zval *v;
@@ -341,6 +566,7 @@ pip_mapping_to_hash(PyObject *o, HashTable *ht TSRMLS_DC)
 			 */
 			str = PyObject_Str(key);
 			if (!str || PyString_AsStringAndSize(str, &name, &name_len) == -1) {
+				Py_XDECREF(str);
 				Py_DECREF(key);
 				status = FAILURE;
 				break;
@@ -359,12 +585,11 @@ pip_mapping_to_hash(PyObject *o, HashTable *ht TSRMLS_DC)
 
 			/*
 			 * Attempt to convert the item from a Python object to a PHP
-			 * value.  This involves allocating a new zval.  If the
-			 * conversion fails, we must remember to free the allocated zval
-			 * below.
+			 * value.  The memo may hand us back a zval that we've already
+			 * produced for this same object.
 			 */
-			ALLOC_INIT_ZVAL(v);
-			status = pip_pyobject_to_zval(item, v TSRMLS_CC);
+			v = pip_item_to_zval(item, memo TSRMLS_CC);
+			status = (v != NULL) ? SUCCESS : FAILURE;
 
 			/*
 			 * If we've been successful up to this point, attempt to add the
@@ -383,13 +608,13 @@ pip_mapping_to_hash(PyObject *o, HashTable *ht TSRMLS_DC)
 			Py_DECREF(key);
 
 			/*
-			 * If we've failed to convert and insert this item, free our
-			 * allocated zval and break out of our loop with a failure
+			 * If we've failed to convert and insert this item, release our
+			 * zval reference and break out of our loop with a failure
 			 * status.
 			 */
 			if (status == FAILURE) {
-				zval_dtor(v);
-				FREE_ZVAL(v);
+				if (v)
+					zval_ptr_dtor(&v);
 				break;
 			}
 		}
@@ -405,12 +630,102 @@ pip_mapping_to_hash(PyObject *o, HashTable *ht TSRMLS_DC)
 int
 pip_mapping_to_array(PyObject *o, zval *zv TSRMLS_DC)
 {
+	HashTable memo;
+	int status = FAILURE;
+
+	PHP_PYTHON_THREAD_ASSERT();
+
+	if (array_init(zv) == SUCCESS) {
+		pip_memo_init(&memo);
+		status = pip_mapping_to_hash(o, Z_ARRVAL_P(zv), &memo TSRMLS_CC);
+		zend_hash_destroy(&memo);
+	}
+
+	return status;
+}
+/* }}} */
+/* {{{ pip_unicode_to_zval(PyObject *o, zval *zv TSRMLS_DC)
+   Convert a Python Unicode string to a UTF-8 encoded PHP string. */
+static int
+pip_unicode_to_zval(PyObject *o, zval *zv TSRMLS_DC)
+{
+	const Py_UNICODE *u;
+	Py_ssize_t i, size;
+	size_t len = 0;
+	char *str, *p;
+
 	PHP_PYTHON_THREAD_ASSERT();
 
-	if (array_init(zv) == SUCCESS)
-		return pip_mapping_to_hash(o, Z_ARRVAL_P(zv) TSRMLS_CC);
+	u = PyUnicode_AS_UNICODE(o);
+	size = PyUnicode_GET_SIZE(o);
+
+	/*
+	 * Rather than encoding into a temporary Python string and copying that
+	 * into the zval, we encode straight into the zval's own buffer.  The
+	 * first pass computes the exact encoded length so that the buffer can
+	 * be allocated once.
+	 *
+	 * On narrow (UCS-2) builds, a valid surrogate pair is combined into a
+	 * single four-byte sequence.  Lone surrogates are encoded as-is, which
+	 * matches the behavior of Python's own UTF-8 codec.
+	 */
+	for (i = 0; i < size; ++i) {
+		Py_UCS4 ch = u[i];
+
+#if Py_UNICODE_SIZE == 2
+		if (ch >= 0xD800 && ch <= 0xDBFF && i + 1 < size &&
+			u[i + 1] >= 0xDC00 && u[i + 1] <= 0xDFFF) {
+			len += 4;
+			++i;
+			continue;
+		}
+#endif
+
+		if (ch < 0x80)
+			len += 1;
+		else if (ch < 0x800)
+			len += 2;
+		else if (ch < 0x10000)
+			len += 3;
+		else
+			len += 4;
+	}
+
+	p = str = emalloc(len + 1);
+
+	for (i = 0; i < size; ++i) {
+		Py_UCS4 ch = u[i];
+
+#if Py_UNICODE_SIZE == 2
+		if (ch >= 0xD800 && ch <= 0xDBFF && i + 1 < size &&
+			u[i + 1] >= 0xDC00 && u[i + 1] <= 0xDFFF) {
+			ch = 0x10000 + (((ch & 0x3FF) << 10) | (u[i + 1] & 0x3FF));
+			++i;
+		}
+#endif
 
-	return FAILURE;
+		if (ch < 0x80) {
+			*p++ = (char)ch;
+		} else if (ch < 0x800) {
+			*p++ = (char)(0xC0 | (ch >> 6));
+			*p++ = (char)(0x80 | (ch & 0x3F));
+		} else if (ch < 0x10000) {
+			*p++ = (char)(0xE0 | (ch >> 12));
+			*p++ = (char)(0x80 | ((ch >> 6) & 0x3F));
+			*p++ = (char)(0x80 | (ch & 0x3F));
+		} else {
+			*p++ = (char)(0xF0 | (ch >> 18));
+			*p++ = (char)(0x80 | ((ch >> 12) & 0x3F));
+			*p++ = (char)(0x80 | ((ch >> 6) & 0x3F));
+			*p++ = (char)(0x80 | (ch & 0x3F));
+		}
+	}
+	*p = '\0';
+
+	/* The zval takes ownership of the encoded buffer. */
+	ZVAL_STRINGL(zv, str, len, 0);
+
+	return SUCCESS;
 }
 /* }}} */
 /* {{{ pip_pyobject_to_zobject(PyObject *o, zval *zv TSRMLS_DC)
@@ -435,6 +750,14 @@ pip_pyobject_to_zobject(PyObject *o, zval *zv TSRMLS_DC)
 	Py_INCREF(o);
 	pip->object = o;
 
+	/*
+	 * Remember which wrapper's properties we are being converted for, if
+	 * any.  A nested structure is converted one level at a time, so this
+	 * chain is how python_get_properties() finds the wrappers that are
+	 * already part of this conversion when a structure contains itself.
+	 */
+	pip->parent = PYG(convert_parent);
+
 	return SUCCESS;
 }
 /* }}} */
@@ -443,6 +766,8 @@ pip_pyobject_to_zobject(PyObject *o, zval *zv TSRMLS_DC)
 int
 pip_pyobject_to_zval(PyObject *o, zval *zv TSRMLS_DC)
 {
+	zval *callable;
+
 	PHP_PYTHON_THREAD_ASSERT();
 
 	/*
@@ -494,7 +819,9 @@ pip_pyobject_to_zval(PyObject *o, zval *zv TSRMLS_DC)
 
 	/*
 	 * Python strings are converted directly to PHP strings.  The contents
-	 * of the string are copied (i.e., duplicated) into the zval.
+	 * of the string are copied (i.e., duplicated) into the zval.  This is
+	 * the only copy made: PHP strings must live in memory owned by the
+	 * Zend allocator, so we can't adopt the Python object's storage.
 	 */
 	if (PyString_Check(o)) {
 		ZVAL_STRINGL(zv, PyString_AS_STRING(o), PyString_GET_SIZE(o), 1);
@@ -502,24 +829,25 @@ pip_pyobject_to_zval(PyObject *o, zval *zv TSRMLS_DC)
 	}
 
 	/*
-	 * Python Unicode strings are converted to UTF8 and stored as PHP
-	 * strings.  It is possible for this encoding-based conversion to fail.
-	 * The contents of the UTF9-encoded string are copied (i.e., duplicated)
-	 * into the zval.
+	 * Python Unicode strings are encoded as UTF-8 directly into the PHP
+	 * string's buffer.
 	 *
 	 * TODO:
 	 * - Support richer conversions if PHP's Unicode support is available.
-	 * - Potentially break this conversion out into its own routine.
 	 */
-	if (PyUnicode_Check(o)) {
-		PyObject *s = PyUnicode_AsUTF8String(o);
-		if (s) {
-			ZVAL_STRINGL(zv, PyString_AS_STRING(s), PyString_GET_SIZE(s), 1);
-			Py_DECREF(s);
-			return SUCCESS;
-		}
+	if (PyUnicode_Check(o))
+		return pip_unicode_to_zval(o, zv TSRMLS_CC);
 
-		return FAILURE;
+	/*
+	 * php.Function objects are handed back to PHP as the callable that
+	 * they were created from, and php.Array objects as their array.
+	 */
+	if ((callable = python_function_callable(o)) != NULL ||
+		(callable = python_array_zval(o)) != NULL) {
+		zv->value = callable->value;
+		Z_TYPE_P(zv) = Z_TYPE_P(callable);
+		zval_copy_ctor(zv);
+		return SUCCESS;
 	}
 
 	/*
@@ -0,0 +1,191 @@
+/*
+ * Python in PHP - Embedded Python Extension
+ *
+ * Copyright (c) 2003,2004,2005,2006,2007,2008 Jon Parise <jon@php.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * $Id$
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "php_python_internal.h"
+
+ZEND_EXTERN_MODULE_GLOBALS(python);
+
+/*
+ * Coroutines are driven by an event loop that belongs to the request's
+ * interpreter.  The loop is created the first time a coroutine is run and
+ * closed when the request ends.  Python 2 has no asyncio module of its own,
+ * so we fall back to trollius, its backport, when asyncio isn't available.
+ */
+
+/* {{{ coroutine_module(TSRMLS_D)
+   Return a borrowed reference to the asyncio module, importing it first if
+   necessary.  Returns NULL with a Python exception set on failure. */
+static PyObject *
+coroutine_module(TSRMLS_D)
+{
+	if (PYG(asyncio) == NULL) {
+		PYG(asyncio) = PyImport_ImportModule("asyncio");
+		if (PYG(asyncio) == NULL &&
+			PyErr_ExceptionMatches(PyExc_ImportError)) {
+			PyErr_Clear();
+			PYG(asyncio) = PyImport_ImportModule("trollius");
+		}
+	}
+
+	return PYG(asyncio);
+}
+/* }}} */
+/* {{{ coroutine_loop(TSRMLS_D)
+   Return a borrowed reference to the request's event loop, creating it if
+   necessary.  Returns NULL with a Python exception set on failure. */
+static PyObject *
+coroutine_loop(TSRMLS_D)
+{
+	PyObject *asyncio, *result;
+
+	if (PYG(event_loop))
+		return PYG(event_loop);
+
+	asyncio = coroutine_module(TSRMLS_C);
+	if (asyncio == NULL)
+		return NULL;
+
+	PYG(event_loop) = PyObject_CallMethod(asyncio, "new_event_loop", NULL);
+	if (PYG(event_loop) == NULL)
+		return NULL;
+
+	/* Coroutines that look up the current loop should find ours. */
+	result = PyObject_CallMethod(asyncio, "set_event_loop", "O",
+								 PYG(event_loop));
+	if (result == NULL) {
+		Py_CLEAR(PYG(event_loop));
+		return NULL;
+	}
+	Py_DECREF(result);
+
+	return PYG(event_loop);
+}
+/* }}} */
+/* {{{ python_coroutine_run(PyObject *awaitable, double timeout TSRMLS_DC)
+   Run the request's event loop until the awaitable completes, or until the
+   timeout (in seconds) expires if it is positive, in which case the
+   awaitable is cancelled.  Returns a new reference to the result, or NULL
+   with a Python exception set. */
+PyObject *
+python_coroutine_run(PyObject *awaitable, double timeout TSRMLS_DC)
+{
+	PyObject *loop, *task, *result;
+
+	PHP_PYTHON_THREAD_ASSERT();
+
+	loop = coroutine_loop(TSRMLS_C);
+	if (loop == NULL)
+		return NULL;
+
+	if (timeout > 0)
+		task = PyObject_CallMethod(PYG(asyncio), "wait_for", "Od", awaitable,
+								   timeout);
+	else {
+		task = awaitable;
+		Py_INCREF(task);
+	}
+
+	if (task == NULL)
+		return NULL;
+
+	result = PyObject_CallMethod(loop, "run_until_complete", "O", task);
+	Py_DECREF(task);
+
+	return result;
+}
+/* }}} */
+/* {{{ python_coroutine_gather(PyObject *awaitables, double timeout TSRMLS_DC)
+   Run the sequence of awaitables concurrently on the request's event loop.
+   Returns a new reference to a list of their results, in which the
+   awaitables that raised are represented by their exceptions, or NULL with
+   a Python exception set if the whole group failed or timed out. */
+PyObject *
+python_coroutine_gather(PyObject *awaitables, double timeout TSRMLS_DC)
+{
+	PyObject *gather, *args, *kwargs, *group, *result;
+
+	PHP_PYTHON_THREAD_ASSERT();
+
+	if (coroutine_loop(TSRMLS_C) == NULL)
+		return NULL;
+
+	gather = PyObject_GetAttrString(PYG(asyncio), "gather");
+	if (gather == NULL)
+		return NULL;
+
+	args = PySequence_Tuple(awaitables);
+	kwargs = Py_BuildValue("{s:O}", "return_exceptions", Py_True);
+	group = (args && kwargs) ? PyObject_Call(gather, args, kwargs) : NULL;
+
+	Py_XDECREF(kwargs);
+	Py_XDECREF(args);
+	Py_DECREF(gather);
+
+	if (group == NULL)
+		return NULL;
+
+	result = python_coroutine_run(group, timeout TSRMLS_CC);
+	Py_DECREF(group);
+
+	return result;
+}
+/* }}} */
+/* {{{ python_coroutine_shutdown(TSRMLS_D)
+   Close the request's event loop.  The thread state must be held. */
+void
+python_coroutine_shutdown(TSRMLS_D)
+{
+	PyObject *result;
+
+	PHP_PYTHON_THREAD_ASSERT();
+
+	if (PYG(event_loop)) {
+		result = PyObject_CallMethod(PYG(event_loop), "close", NULL);
+		if (result)
+			Py_DECREF(result);
+		else
+			PyErr_Clear();
+	}
+
+	Py_CLEAR(PYG(event_loop));
+	Py_CLEAR(PYG(asyncio));
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * tab-width: 4
+ * End:
+ * vim600: fdm=marker
+ * vim: sw=4 ts=4 noet
+ */
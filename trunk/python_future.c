@@ -0,0 +1,500 @@
+/*
+ * Python in PHP - Embedded Python Extension
+ *
+ * Copyright (c) 2003,2004,2005,2006,2007,2008 Jon Parise <jon@php.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * $Id$
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "php_python_internal.h"
+#include "pythread.h"
+
+#ifdef PHP_WIN32
+#include "win32/time.h"
+#else
+#include <sys/time.h>
+#include <errno.h>
+#include <pthread.h>
+#endif
+
+ZEND_EXTERN_MODULE_GLOBALS(python);
+
+/*
+ * A future represents a Python call running on its own thread in the
+ * request's interpreter.  The worker thread creates a thread state for the
+ * interpreter, makes the call and records its result (or exception), and
+ * then sets the future's "done" signal.  Python 2's locks don't support
+ * timed acquisition, so the signal is an event (on Windows) or a condition
+ * variable (elsewhere), which lets wait() block until the call finishes or
+ * its timeout elapses.
+ *
+ * Futures can't outlive the request's interpreter, so every future is also
+ * kept on a per-request list that is joined before the interpreter ends.
+ */
+
+/* {{{ future_signal
+ */
+typedef struct _future_signal {
+#ifdef PHP_WIN32
+	HANDLE					event;
+#else
+	pthread_mutex_t			mutex;
+	pthread_cond_t			cond;
+	int						set;
+#endif
+} future_signal;
+/* }}} */
+/* {{{ python_future
+ */
+struct _python_future {
+	zend_object				base;
+	PyInterpreterState *	interp;
+	PyObject *				callable;
+	PyObject *				args;
+	PyObject *				result;
+	PyObject *				type;
+	PyObject *				value;
+	PyObject *				traceback;
+	future_signal *			done;
+	int						finished;
+	python_future *			prev;
+	python_future *			next;
+};
+/* }}} */
+
+zend_class_entry *python_future_class_entry;
+static zend_object_handlers python_future_handlers;
+
+/* {{{ signal_new()
+   Allocate a new, unset signal.  Returns NULL on failure. */
+static future_signal *
+signal_new()
+{
+	future_signal *s = emalloc(sizeof(future_signal));
+
+#ifdef PHP_WIN32
+	s->event = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if (s->event == NULL) {
+		efree(s);
+		return NULL;
+	}
+#else
+	if (pthread_mutex_init(&s->mutex, NULL) != 0) {
+		efree(s);
+		return NULL;
+	}
+	if (pthread_cond_init(&s->cond, NULL) != 0) {
+		pthread_mutex_destroy(&s->mutex);
+		efree(s);
+		return NULL;
+	}
+	s->set = 0;
+#endif
+
+	return s;
+}
+/* }}} */
+/* {{{ signal_free(future_signal *s)
+ */
+static void
+signal_free(future_signal *s)
+{
+#ifdef PHP_WIN32
+	CloseHandle(s->event);
+#else
+	pthread_cond_destroy(&s->cond);
+	pthread_mutex_destroy(&s->mutex);
+#endif
+	efree(s);
+}
+/* }}} */
+/* {{{ signal_set(future_signal *s)
+   Set the signal, waking all of its waiters. */
+static void
+signal_set(future_signal *s)
+{
+#ifdef PHP_WIN32
+	SetEvent(s->event);
+#else
+	pthread_mutex_lock(&s->mutex);
+	s->set = 1;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->mutex);
+#endif
+}
+/* }}} */
+/* {{{ signal_wait(future_signal *s, double timeout)
+   Block for up to timeout seconds (forever, if negative) until the signal is
+   set.  Returns non-zero if it was set. */
+static int
+signal_wait(future_signal *s, double timeout)
+{
+#ifdef PHP_WIN32
+	DWORD ms = (timeout < 0) ? INFINITE : (DWORD)(timeout * 1000.0);
+
+	return WaitForSingleObject(s->event, ms) == WAIT_OBJECT_0;
+#else
+	struct timespec deadline;
+	double when;
+	int set, rc = 0;
+
+	if (timeout >= 0) {
+		when = python_future_now() + timeout;
+		deadline.tv_sec = (time_t)when;
+		deadline.tv_nsec = (long)((when - (double)deadline.tv_sec) * 1e9);
+	}
+
+	pthread_mutex_lock(&s->mutex);
+	while (!s->set && rc != ETIMEDOUT) {
+		if (timeout < 0)
+			pthread_cond_wait(&s->cond, &s->mutex);
+		else
+			rc = pthread_cond_timedwait(&s->cond, &s->mutex, &deadline);
+	}
+	set = s->set;
+	pthread_mutex_unlock(&s->mutex);
+
+	return set;
+#endif
+}
+/* }}} */
+
+/* {{{ future_run(void *arg)
+   The worker thread's entry point. */
+static void
+future_run(void *arg)
+{
+	python_future *f = (python_future *)arg;
+	PyThreadState *tstate;
+
+	tstate = PyThreadState_New(f->interp);
+	PyEval_AcquireThread(tstate);
+
+	f->result = PyObject_CallObject(f->callable, f->args);
+	if (f->result == NULL)
+		PyErr_Fetch(&f->type, &f->value, &f->traceback);
+
+	/*
+	 * The callable and its arguments may hold PHP values, which can only
+	 * be released on the request's thread, so they are left for
+	 * future_release().
+	 */
+
+	/* This also releases the interpreter lock. */
+	PyThreadState_Clear(tstate);
+	PyThreadState_DeleteCurrent();
+
+	signal_set(f->done);
+}
+/* }}} */
+/* {{{ python_future_now()
+   Return the current time in seconds. */
+double
+python_future_now()
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (double)tv.tv_sec + (double)tv.tv_usec / 1000000.0;
+}
+/* }}} */
+/* {{{ future_join(python_future *f, double timeout TSRMLS_DC)
+   Wait up to timeout seconds (forever, if negative) for the future's call
+   to finish.  The request's thread state is given up while waiting so that
+   the worker thread can run.  Returns non-zero if the call has finished. */
+static int
+future_join(python_future *f, double timeout TSRMLS_DC)
+{
+	int depth = 0, held = (PYG(thread_depth) > 0);
+
+	if (f->finished || f->done == NULL)
+		return f->finished;
+
+	if (held)
+		PHP_PYTHON_THREAD_SUSPEND(depth);
+
+	f->finished = signal_wait(f->done, timeout);
+
+	if (held)
+		PHP_PYTHON_THREAD_RESUME(depth);
+
+	return f->finished;
+}
+/* }}} */
+/* {{{ future_release(python_future *f TSRMLS_DC)
+   Release the finished future's Python objects and remove it from the
+   request's list.  The thread state must be held. */
+static void
+future_release(python_future *f TSRMLS_DC)
+{
+	PHP_PYTHON_THREAD_ASSERT();
+
+	Py_CLEAR(f->callable);
+	Py_CLEAR(f->args);
+	Py_CLEAR(f->result);
+	Py_CLEAR(f->type);
+	Py_CLEAR(f->value);
+	Py_CLEAR(f->traceback);
+
+	if (f->done) {
+		signal_free(f->done);
+		f->done = NULL;
+	}
+
+	if (f->prev)
+		f->prev->next = f->next;
+	else if (PYG(futures) == f)
+		PYG(futures) = f->next;
+	if (f->next)
+		f->next->prev = f->prev;
+	f->prev = f->next = NULL;
+}
+/* }}} */
+/* {{{ python_future_destroy(void *object, zend_object_handle handle TSRMLS_DC)
+ */
+static void
+python_future_destroy(void *object, zend_object_handle handle TSRMLS_DC)
+{
+	python_future *f = (python_future *)object;
+
+	/* The worker thread may still be using this future. */
+	future_join(f, -1 TSRMLS_CC);
+
+	PHP_PYTHON_THREAD_ACQUIRE();
+	future_release(f TSRMLS_CC);
+	PHP_PYTHON_THREAD_RELEASE();
+
+	zend_object_std_dtor(&f->base TSRMLS_CC);
+}
+/* }}} */
+/* {{{ python_future_free(void *object TSRMLS_DC)
+ */
+static void
+python_future_free(void *object TSRMLS_DC)
+{
+	efree(object);
+}
+/* }}} */
+/* {{{ python_future_create(zend_class_entry *ce TSRMLS_DC)
+ */
+static zend_object_value
+python_future_create(zend_class_entry *ce TSRMLS_DC)
+{
+	zval *tmp;
+	python_future *f;
+	zend_object_value retval;
+
+	f = ecalloc(1, sizeof(python_future));
+
+	zend_object_std_init(&f->base, ce TSRMLS_CC);
+	zend_hash_copy(f->base.properties, &ce->default_properties,
+				   (copy_ctor_func_t)zval_add_ref,
+				   (void *) &tmp, sizeof(zval *));
+
+	retval.handle = zend_objects_store_put(f, python_future_destroy,
+										   python_future_free, NULL TSRMLS_CC);
+	retval.handlers = &python_future_handlers;
+
+	return retval;
+}
+/* }}} */
+
+/* {{{ python_future_start(PyObject *callable, PyObject *args, zval *zv TSRMLS_DC)
+   Start calling callable(*args) on a new worker thread and initialize zv as
+   the PythonFuture object for the call.  Returns FAILURE with a Python
+   exception set if the thread couldn't be started. */
+int
+python_future_start(PyObject *callable, PyObject *args, zval *zv TSRMLS_DC)
+{
+	python_future *f;
+
+	PHP_PYTHON_THREAD_ASSERT();
+
+	if (object_init_ex(zv, python_future_class_entry) != SUCCESS) {
+		PyErr_SetString(PyExc_RuntimeError, "Failed to create future");
+		return FAILURE;
+	}
+
+	f = (python_future *)zend_object_store_get_object(zv TSRMLS_CC);
+
+	f->done = signal_new();
+	if (f->done == NULL) {
+		PyErr_SetString(PyExc_RuntimeError, "Failed to allocate signal");
+		return FAILURE;
+	}
+
+	f->interp = PYG(tstate)->interp;
+	f->callable = callable;
+	Py_INCREF(callable);
+	f->args = args ? args : PyTuple_New(0);
+	Py_XINCREF(args);
+
+	f->next = PYG(futures);
+	if (f->next)
+		f->next->prev = f;
+	PYG(futures) = f;
+
+	if (PyThread_start_new_thread(future_run, f) == -1) {
+		signal_set(f->done);
+		f->finished = 1;
+		PyErr_SetString(PyExc_RuntimeError, "Failed to start worker thread");
+		return FAILURE;
+	}
+
+	return SUCCESS;
+}
+/* }}} */
+/* {{{ python_future_wait(zval *zv, double timeout, zval *result TSRMLS_DC)
+   Wait up to timeout seconds (forever, if negative) for the future's result
+   and store it in result.  Returns FAILURE, after issuing a warning, if the
+   call raised an exception or didn't finish in time. */
+int
+python_future_wait(zval *zv, double timeout, zval *result TSRMLS_DC)
+{
+	python_future *f;
+	int ret = FAILURE;
+
+	if (Z_TYPE_P(zv) != IS_OBJECT ||
+		Z_OBJ_HT_P(zv) != &python_future_handlers) {
+		php_error(E_WARNING, "Python: Expected a PythonFuture object");
+		return FAILURE;
+	}
+
+	f = (python_future *)zend_object_store_get_object(zv TSRMLS_CC);
+	if (f->done == NULL) {
+		php_error(E_WARNING, "Python: PythonFuture object is not initialized");
+		return FAILURE;
+	}
+
+	if (!future_join(f, timeout TSRMLS_CC)) {
+		php_error(E_WARNING, "Python: Timed out waiting for the result");
+		return FAILURE;
+	}
+
+	PHP_PYTHON_THREAD_ACQUIRE();
+
+	if (f->result)
+		ret = pip_pyobject_to_zval(f->result, result TSRMLS_CC);
+	else if (f->type) {
+		/* Keep our copy of the exception for later calls to wait(). */
+		Py_INCREF(f->type);
+		Py_XINCREF(f->value);
+		Py_XINCREF(f->traceback);
+		PyErr_Restore(f->type, f->value, f->traceback);
+		python_error(E_WARNING TSRMLS_CC);
+	}
+
+	PHP_PYTHON_THREAD_RELEASE();
+
+	return ret;
+}
+/* }}} */
+/* {{{ python_future_join_all(TSRMLS_D)
+   Wait for all of the request's outstanding futures and release them.  This
+   must run before the request's interpreter is destroyed. */
+void
+python_future_join_all(TSRMLS_D)
+{
+	python_future *f;
+
+	for (f = PYG(futures); f; f = f->next)
+		future_join(f, -1 TSRMLS_CC);
+
+	PHP_PYTHON_THREAD_ACQUIRE();
+	while (PYG(futures))
+		future_release(PYG(futures) TSRMLS_CC);
+	PHP_PYTHON_THREAD_RELEASE();
+}
+/* }}} */
+
+/* {{{ proto mixed PythonFuture::wait([float timeout])
+   Wait for the call to finish and return its result.  Returns NULL if the
+   call raised an exception or the timeout (in seconds) expires. */
+PHP_METHOD(PythonFuture, wait)
+{
+	double timeout = -1;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|d",
+							  &timeout) == FAILURE) {
+		return;
+	}
+
+	if (python_future_wait(getThis(), timeout, return_value TSRMLS_CC) == FAILURE) {
+		zval_dtor(return_value);
+		RETURN_NULL();
+	}
+}
+/* }}} */
+/* {{{ proto bool PythonFuture::done()
+   Returns true if the call has finished. */
+PHP_METHOD(PythonFuture, done)
+{
+	python_future *f;
+
+	f = (python_future *)zend_object_store_get_object(getThis() TSRMLS_CC);
+
+	RETURN_BOOL(f->done && future_join(f, 0 TSRMLS_CC));
+}
+/* }}} */
+
+/* {{{ python_future_methods[]
+ */
+static zend_function_entry python_future_methods[] = {
+	PHP_ME(PythonFuture, wait, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(PythonFuture, done, NULL, ZEND_ACC_PUBLIC)
+	{NULL, NULL, NULL}
+};
+/* }}} */
+
+/* {{{ python_future_init(TSRMLS_D)
+   Register the PythonFuture class. */
+int
+python_future_init(TSRMLS_D)
+{
+	zend_class_entry ce;
+
+	INIT_CLASS_ENTRY(ce, "PythonFuture", python_future_methods);
+	python_future_class_entry = zend_register_internal_class(&ce TSRMLS_CC);
+	python_future_class_entry->create_object = python_future_create;
+	python_future_class_entry->ce_flags |= ZEND_ACC_FINAL_CLASS;
+
+	memcpy(&python_future_handlers, zend_get_std_object_handlers(),
+		   sizeof(zend_object_handlers));
+	python_future_handlers.clone_obj = NULL;
+
+	return SUCCESS;
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * tab-width: 4
+ * End:
+ * vim600: fdm=marker
+ * vim: sw=4 ts=4 noet
+ */
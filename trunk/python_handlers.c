@@ -58,10 +58,11 @@ efree_function(zend_internal_function *func)
 	efree(func);
 }
 /* }}} */
-/* {{{ merge_class_dict(PyObject *o, HashTable *ht TSRMLS_DC)
+/* {{{ merge_class_dict(PyObject *o, HashTable *ht, HashTable *memo, HashTable *seen TSRMLS_DC)
    Merge the contents of the class's __dict__ attribute into the hashtable. */
 static int
-merge_class_dict(PyObject *o, HashTable *ht TSRMLS_DC)
+merge_class_dict(PyObject *o, HashTable *ht, HashTable *memo,
+				 HashTable *seen TSRMLS_DC)
 {
 	PyObject *d;
 	PyObject *bases;
@@ -71,6 +72,15 @@ merge_class_dict(PyObject *o, HashTable *ht TSRMLS_DC)
 	/* We assume that the Python object is a class type. */
 	assert(PyClass_Check(o));
 
+	/*
+	 * A class can be reached more than once through multiple inheritance
+	 * (the classic "diamond").  Its dictionary only needs to be merged the
+	 * first time we encounter it.
+	 */
+	if (zend_hash_add(seen, (char *)&o, sizeof(o), (void *)&o,
+					  sizeof(PyObject *), NULL) == FAILURE)
+		return SUCCESS;
+
 	/*
 	 * Start by attempting to merge the contents of the class type's __dict__.
 	 * It's alright if the class type doesn't have a __dict__ attribute.
@@ -79,7 +89,7 @@ merge_class_dict(PyObject *o, HashTable *ht TSRMLS_DC)
 	if (d == NULL)
 		PyErr_Clear();
 	else {
-		int result = pip_mapping_to_hash(d, ht TSRMLS_CC);
+		int result = pip_mapping_to_hash(d, ht, memo TSRMLS_CC);
 		Py_DECREF(d);
 		if (result != SUCCESS)
 			return FAILURE;
@@ -106,7 +116,7 @@ merge_class_dict(PyObject *o, HashTable *ht TSRMLS_DC)
 				}
 
 				/* Recurse through this base class. */
-				status = merge_class_dict(base, ht TSRMLS_CC);
+				status = merge_class_dict(base, ht, memo, seen TSRMLS_CC);
 				Py_DECREF(base);
 				if (status != SUCCESS) {
 					Py_DECREF(bases);
@@ -122,10 +132,10 @@ merge_class_dict(PyObject *o, HashTable *ht TSRMLS_DC)
 	return SUCCESS;
 }
 /* }}} */
-/* {{{ get_properties(PyObject *o, HashTable *ht TSRMLS_DC)
+/* {{{ get_properties(PyObject *o, HashTable *ht, HashTable *memo TSRMLS_DC)
    Populate a HashTable with the given object's properties. */
 static int
-get_properties(PyObject *o, HashTable *ht TSRMLS_DC)
+get_properties(PyObject *o, HashTable *ht, HashTable *memo TSRMLS_DC)
 {
 	PyObject *attr;
 	int status;
@@ -146,10 +156,10 @@ get_properties(PyObject *o, HashTable *ht TSRMLS_DC)
 	 * object that also has a legitimate set of additional properties.
 	 */
 	if (PySequence_Check(o))
-		return pip_sequence_to_hash(o, ht TSRMLS_CC);
+		return pip_sequence_to_hash(o, ht, memo TSRMLS_CC);
 
 	if (PyMapping_Check(o))
-		return pip_mapping_to_hash(o, ht TSRMLS_CC);
+		return pip_mapping_to_hash(o, ht, memo TSRMLS_CC);
 
 	/*
 	 * Attempt to append the contents of this object's __dict__ attribute to
@@ -162,7 +172,7 @@ get_properties(PyObject *o, HashTable *ht TSRMLS_DC)
 		return FAILURE;
 	}
 
-	status = pip_mapping_to_hash(attr, ht TSRMLS_CC);
+	status = pip_mapping_to_hash(attr, ht, memo TSRMLS_CC);
 	Py_DECREF(attr);
 
 	/*
@@ -172,7 +182,11 @@ get_properties(PyObject *o, HashTable *ht TSRMLS_DC)
 	if (status == SUCCESS) {
 		attr = PyObject_GetAttrString(o, "__class__");
 		if (attr) {
-			status = merge_class_dict(attr, ht TSRMLS_CC);
+			HashTable seen;
+
+			zend_hash_init(&seen, 8, NULL, NULL, 0);
+			status = merge_class_dict(attr, ht, memo, &seen TSRMLS_CC);
+			zend_hash_destroy(&seen);
 			Py_DECREF(attr);
 		}
 	}
@@ -464,14 +478,52 @@ static HashTable *
 python_get_properties(zval *object TSRMLS_DC)
 {
 	PHP_PYTHON_FETCH(pip, object);
+	php_python_object *ancestor;
+	zend_object_handle handle, parent;
+	HashTable memo;
+	zval *self;
 
-	PHP_PYTHON_THREAD_ACQUIRE();
+	if (zend_hash_num_elements(pip->base.properties) != 0)
+		return pip->base.properties;
+
+	/*
+	 * Seed the conversion memo with this object and the live wrappers it
+	 * was converted for, so that a container which (directly or
+	 * indirectly) holds itself refers back to those very PHP objects
+	 * instead of producing an endless chain of new wrappers.  We use our
+	 * own zvals for this; the caller's zval might be a reference.
+	 */
+	pip_memo_init(&memo);
+	handle = Z_OBJ_HANDLE_P(object);
+	while ((ancestor = python_object_find(handle TSRMLS_CC)) != NULL &&
+		   pip_memo_find(&memo, ancestor->object) == NULL) {
+		MAKE_STD_ZVAL(self);
+		Z_TYPE_P(self) = IS_OBJECT;
+		Z_OBJ_HANDLE_P(self) = handle;
+		Z_OBJ_HT_P(self) = Z_OBJ_HT_P(object);
+		zend_objects_store_add_ref(self TSRMLS_CC);
+		pip_memo_add(&memo, ancestor->object, self);
+		zval_ptr_dtor(&self);
+		handle = ancestor->parent;
+	}
 
-	if (zend_hash_num_elements(pip->base.properties) == 0)
-		get_properties(pip->object, pip->base.properties TSRMLS_CC);
+	/* The wrappers created below are converted on behalf of this one. */
+	parent = PYG(convert_parent);
+	PYG(convert_parent) = Z_OBJ_HANDLE_P(object);
 
+	PHP_PYTHON_THREAD_ACQUIRE();
+	get_properties(pip->object, pip->base.properties, &memo TSRMLS_CC);
 	PHP_PYTHON_THREAD_RELEASE();
 
+	PYG(convert_parent) = parent;
+
+	/*
+	 * Destroy the memo after releasing the thread state.  Dropping the last
+	 * reference to a converted object runs its destructor, which needs to
+	 * acquire the thread state itself.
+	 */
+	zend_hash_destroy(&memo);
+
     return pip->base.properties;
 }
 /* }}} */
@@ -651,15 +703,12 @@ python_cast(zval *readobj, zval *writeobj, int type TSRMLS_DC)
 	PyObject *val = NULL;
 	int ret = FAILURE;
 
+	if (type != IS_STRING)
+		return FAILURE;
+
 	PHP_PYTHON_THREAD_ACQUIRE();
 
-	switch (type) {
-		case IS_STRING:
-			val = PyObject_Str(pip->object);
-			break;
-		default:
-			return FAILURE;
-	}
+	val = PyObject_Str(pip->object);
 
 	if (val) {
 		ret = pip_pyobject_to_zval(val, writeobj TSRMLS_CC);
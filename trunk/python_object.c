@@ -102,6 +102,7 @@ python_object_create(zend_class_entry *ce TSRMLS_DC)
 	memset(&pip->base, 0, sizeof(zend_object));
 	pip->object = NULL;
 	pip->ce = ce;
+	pip->parent = 0;
 
 	zend_object_std_init(&pip->base, ce TSRMLS_CC);
 	zend_hash_copy(pip->base.properties, &ce->default_properties,
@@ -120,6 +121,45 @@ python_object_create(zend_class_entry *ce TSRMLS_DC)
 }
 /* }}} */
 
+/* {{{ python_object_find(zend_object_handle handle TSRMLS_DC)
+   Return the PHP Python object with the given handle, or NULL if that handle
+   no longer refers to a live PHP Python object. */
+php_python_object *
+python_object_find(zend_object_handle handle TSRMLS_DC)
+{
+	zend_object_store_bucket *bucket;
+	php_python_object *pip;
+
+	if (handle == 0 || handle >= EG(objects_store).top)
+		return NULL;
+
+	bucket = &EG(objects_store).object_buckets[handle];
+	if (!bucket->valid || bucket->bucket.obj.free_storage != python_object_free)
+		return NULL;
+
+	pip = (php_python_object *)bucket->bucket.obj.object;
+
+	return pip->object ? pip : NULL;
+}
+/* }}} */
+
+/* {{{ python_object_from_zval(zval *zv TSRMLS_DC)
+   Returns the Python object wrapped by the given PHP object (as a borrowed
+   reference), or NULL if the zval isn't a PHP Python object. */
+PyObject *
+python_object_from_zval(zval *zv TSRMLS_DC)
+{
+	php_python_object *pip;
+
+	if (Z_TYPE_P(zv) != IS_OBJECT ||
+		Z_OBJ_HT_P(zv) != &python_object_handlers)
+		return NULL;
+
+	pip = (php_python_object *)zend_object_store_get_object(zv TSRMLS_CC);
+	return pip->object;
+}
+/* }}} */
+
 /* {{{ python_num_args(PyObject *callable TSRMLS_DC)
    Returns the number of arguments expected by the given callable object. */
 zend_uint
@@ -0,0 +1,336 @@
+/*
+ * Python in PHP - Embedded Python Extension
+ *
+ * Copyright (c) 2003,2004,2005,2006,2007,2008 Jon Parise <jon@php.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * $Id$
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "php_python_internal.h"
+
+#if !defined(PHP_WIN32) && !defined(ZTS)
+#define PHP_PYTHON_PARALLEL_FORK 1
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+ZEND_EXTERN_MODULE_GLOBALS(python);
+
+/*
+ * Python 2 has a single interpreter lock that is shared by all of the
+ * process's sub-interpreters, so threads can't run Python code in parallel.
+ * Instead, python_parallel_map() forks a worker process per shard of items.
+ * Each worker maps its shard, pickles the results (or its exception) back
+ * to the parent over a pipe, and exits without running any PHP or Python
+ * shutdown code.  Forking isn't possible on Windows, and isn't safe in a
+ * threaded (ZTS) build, so the items are mapped serially there.
+ */
+
+/* {{{ map_serial(PyObject *function, PyObject *items, Py_ssize_t start, Py_ssize_t end)
+   Call function on each of items[start:end] and return a new list of the
+   results, or NULL with a Python exception set. */
+static PyObject *
+map_serial(PyObject *function, PyObject *items, Py_ssize_t start,
+		   Py_ssize_t end)
+{
+	PyObject *results, *result;
+	Py_ssize_t i;
+
+	results = PyList_New(end - start);
+	if (results == NULL)
+		return NULL;
+
+	for (i = start; i < end; ++i) {
+		result = PyObject_CallFunctionObjArgs(function,
+											  PyList_GET_ITEM(items, i), NULL);
+		if (result == NULL) {
+			Py_DECREF(results);
+			return NULL;
+		}
+		PyList_SET_ITEM(results, i - start, result);
+	}
+
+	return results;
+}
+/* }}} */
+
+#ifdef PHP_PYTHON_PARALLEL_FORK
+
+/* {{{ python_shard
+ */
+typedef struct _python_shard {
+	pid_t		pid;
+	int			fd;				/* read end of the worker's pipe */
+	char *		data;			/* pickled reply */
+	size_t		len;
+	size_t		size;
+} python_shard;
+/* }}} */
+
+/* {{{ shard_run(PyObject *function, PyObject *items, Py_ssize_t start, Py_ssize_t end, int fd)
+   Run a shard in a forked worker process and write its pickled reply, a
+   (succeeded, payload) tuple, to fd.  Never returns. */
+static void
+shard_run(PyObject *function, PyObject *items, Py_ssize_t start,
+		  Py_ssize_t end, int fd)
+{
+	PyObject *results, *reply = NULL, *pickle, *data = NULL;
+	PyObject *type, *value, *traceback, *devnull;
+	char *p;
+	Py_ssize_t len;
+	ssize_t n;
+
+	PyOS_AfterFork();
+
+	/* The worker shares the request's connection; keep it off the wire. */
+	devnull = PyFile_FromString("/dev/null", "w");
+	if (devnull) {
+		PySys_SetObject("stdout", devnull);
+		PySys_SetObject("stderr", devnull);
+		Py_DECREF(devnull);
+	}
+
+	results = map_serial(function, items, start, end);
+	if (results)
+		reply = Py_BuildValue("(ON)", Py_True, results);
+	else {
+		PyErr_Fetch(&type, &value, &traceback);
+		PyErr_NormalizeException(&type, &value, &traceback);
+		reply = Py_BuildValue("(ON)", Py_False,
+							  PyObject_Str(value ? value : type));
+		Py_XDECREF(type);
+		Py_XDECREF(value);
+		Py_XDECREF(traceback);
+	}
+
+	pickle = PyImport_ImportModule("cPickle");
+	if (pickle && reply)
+		data = PyObject_CallMethod(pickle, "dumps", "Oi", reply, 2);
+
+	if (data && PyString_AsStringAndSize(data, &p, &len) == 0) {
+		while (len > 0 && (n = write(fd, p, len)) != 0) {
+			if (n < 0)
+				break;
+			p += n;
+			len -= n;
+		}
+	}
+
+	_exit(data ? 0 : 1);
+}
+/* }}} */
+/* {{{ shards_collect(python_shard *shards, int count)
+   Read every worker's reply until all of the pipes are closed. */
+static void
+shards_collect(python_shard *shards, int count)
+{
+	struct pollfd *fds;
+	int i, open = count;
+	ssize_t n;
+
+	fds = safe_emalloc(count, sizeof(struct pollfd), 0);
+
+	while (open > 0) {
+		for (i = 0; i < count; ++i) {
+			fds[i].fd = shards[i].fd;
+			fds[i].events = POLLIN;
+			fds[i].revents = 0;
+		}
+
+		if (poll(fds, count, -1) < 0) {
+			/* Signals, such as PHP's timeout, interrupt the wait. */
+			if (errno == EINTR)
+				continue;
+
+			/*
+			 * Give up on the remaining workers.  Closing their pipes makes
+			 * any that are still writing fail instead of blocking forever,
+			 * so that they can be reaped.
+			 */
+			for (i = 0; i < count; ++i) {
+				if (shards[i].fd >= 0) {
+					close(shards[i].fd);
+					shards[i].fd = -1;
+				}
+			}
+			break;
+		}
+
+		for (i = 0; i < count; ++i) {
+			python_shard *shard = &shards[i];
+
+			if (shard->fd < 0 || fds[i].revents == 0)
+				continue;
+
+			if (shard->size - shard->len < 8192) {
+				shard->size = shard->size ? shard->size * 2 : 65536;
+				shard->data = erealloc(shard->data, shard->size);
+			}
+
+			n = read(shard->fd, shard->data + shard->len,
+					 shard->size - shard->len);
+			if (n > 0)
+				shard->len += n;
+			else {
+				close(shard->fd);
+				shard->fd = -1;
+				open--;
+			}
+		}
+	}
+
+	efree(fds);
+}
+/* }}} */
+/* {{{ map_forked(PyObject *function, PyObject *items, int workers TSRMLS_DC)
+ */
+static PyObject *
+map_forked(PyObject *function, PyObject *items, int workers TSRMLS_DC)
+{
+	python_shard *shards;
+	PyObject *pickle, *results = NULL, *reply;
+	Py_ssize_t n = PyList_GET_SIZE(items);
+	int i, fds[2], started = 0, depth;
+
+	pickle = PyImport_ImportModule("cPickle");
+	if (pickle == NULL)
+		return NULL;
+
+	shards = ecalloc(workers, sizeof(python_shard));
+
+	for (i = 0; i < workers; ++i) {
+		Py_ssize_t start = n * i / workers, end = n * (i + 1) / workers;
+
+		if (pipe(fds) < 0)
+			break;
+
+		shards[i].pid = fork();
+		if (shards[i].pid == 0) {
+			/*
+			 * A PHP callable runs in the worker too.  Buffer its output,
+			 * which is discarded when the worker exits, so that it stays
+			 * off the request's connection.
+			 */
+			php_start_ob_buffer(NULL, 0, 0 TSRMLS_CC);
+			close(fds[0]);
+			shard_run(function, items, start, end, fds[1]);
+		}
+
+		close(fds[1]);
+		if (shards[i].pid < 0) {
+			close(fds[0]);
+			break;
+		}
+
+		shards[i].fd = fds[0];
+		started++;
+	}
+
+	/* Let other threads run Python while we wait on the workers. */
+	PHP_PYTHON_THREAD_SUSPEND(depth);
+	shards_collect(shards, started);
+	for (i = 0; i < started; ++i)
+		waitpid(shards[i].pid, NULL, 0);
+	PHP_PYTHON_THREAD_RESUME(depth);
+
+	if (started < workers) {
+		PyErr_SetString(PyExc_OSError, "Failed to start worker processes");
+		goto cleanup;
+	}
+
+	results = PyList_New(0);
+
+	for (i = 0; results && i < workers; ++i) {
+		PyObject *payload;
+		int ok;
+
+		reply = PyObject_CallMethod(pickle, "loads", "s#", shards[i].data,
+									(int)shards[i].len);
+		if (reply == NULL || !PyArg_ParseTuple(reply, "iO", &ok, &payload)) {
+			if (!PyErr_Occurred())
+				PyErr_SetString(PyExc_RuntimeError, "Worker process failed");
+			Py_XDECREF(reply);
+			Py_CLEAR(results);
+			break;
+		}
+
+		if (!ok) {
+			PyErr_SetObject(PyExc_RuntimeError, payload);
+			Py_CLEAR(results);
+		} else if (PyList_SetSlice(results, PY_SSIZE_T_MAX, PY_SSIZE_T_MAX,
+								   payload) < 0)
+			Py_CLEAR(results);
+
+		Py_DECREF(reply);
+	}
+
+cleanup:
+	for (i = 0; i < workers; ++i) {
+		if (shards[i].data)
+			efree(shards[i].data);
+	}
+	efree(shards);
+	Py_DECREF(pickle);
+
+	return results;
+}
+/* }}} */
+
+#endif /* PHP_PYTHON_PARALLEL_FORK */
+
+/* {{{ python_parallel_map(PyObject *function, PyObject *items, int workers TSRMLS_DC)
+   Map function over the items (a list) using up to the given number of
+   worker processes, and return a new list of the results in order.
+   Returns NULL with a Python exception set on failure. */
+PyObject *
+python_parallel_map(PyObject *function, PyObject *items, int workers TSRMLS_DC)
+{
+	PHP_PYTHON_THREAD_ASSERT();
+
+	if (workers > PyList_GET_SIZE(items))
+		workers = PyList_GET_SIZE(items);
+
+#ifdef PHP_PYTHON_PARALLEL_FORK
+	if (workers > 1)
+		return map_forked(function, items, workers TSRMLS_CC);
+#endif
+
+	return map_serial(function, items, 0, PyList_GET_SIZE(items));
+}
+/* }}} */
+
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * tab-width: 4
+ * End:
+ * vim600: fdm=marker
+ * vim: sw=4 ts=4 noet
+ */
@@ -27,84 +27,1093 @@
 #include "php.h"
 #include "php_python_internal.h"
 
-/* {{{ efree_array
+ZEND_EXTERN_MODULE_GLOBALS(python);
+
+/* {{{ php_check_thread
+   PHP can only be used from the request's own thread. */
+static int
+php_check_thread(TSRMLS_D)
+{
+	if (PyThreadState_GET() != PYG(tstate)) {
+		PyErr_SetString(PyExc_RuntimeError,
+						"PHP cannot be called from this thread");
+		return FAILURE;
+	}
+
+	return SUCCESS;
+}
+/* }}} */
+
+/* {{{ Function
  */
-static void
-efree_array(zval ***p, int n)
+typedef struct {
+	PyObject_HEAD
+	zval *					callable;
+	char *					name;
+	zend_fcall_info			fci;
+	zend_fcall_info_cache	fcc;
+} Function;
+
+static PyTypeObject Function_Type;
+
+/*
+ * A Function is a PHP callable that has been resolved once, when the object
+ * was created.  Its zend_fcall_info_cache lets every call go straight to the
+ * function without looking it up again.  The argument vector lives on the C
+ * stack unless there are more than FUNCTION_STACK_ARGS arguments.
+ */
+#define FUNCTION_STACK_ARGS		8
+
+/* {{{ Function_invoke
+   Call the function with the given PHP arguments, giving up the thread
+   state while PHP runs.  Returns the PHP return value, or NULL with a
+   Python exception set. */
+static zval *
+Function_invoke(Function *self, zval ***params, int argc TSRMLS_DC)
 {
-	int i;
+	zend_fcall_info fci = self->fci;
+	zend_fcall_info_cache fcc = self->fcc;
+	zval *ret = NULL;
+	int depth, status;
+
+	/*
+	 * The function info is copied because the function may well call back
+	 * into Python and through this same object again.  Arguments may be
+	 * separated so that functions taking references can still be called.
+	 */
+	fci.params = params;
+	fci.param_count = argc;
+	fci.retval_ptr_ptr = &ret;
+	fci.no_separation = 0;
+
+	/*
+	 * Other threads' Python code needn't wait on PHP while it runs.  If the
+	 * function uses Python itself, it simply acquires the thread state again.
+	 */
+	PHP_PYTHON_THREAD_SUSPEND(depth);
+	status = zend_call_function(&fci, &fcc TSRMLS_CC);
+	PHP_PYTHON_THREAD_RESUME(depth);
+
+	if (status != SUCCESS || ret == NULL) {
+		PyErr_Format(PyExc_Exception, "Failed to execute function: %s",
+					 self->name);
+		if (ret)
+			zval_ptr_dtor(&ret);
+		return NULL;
+	}
+
+	return ret;
+}
+/* }}} */
+/* {{{ Function_call_items
+   Convert the given Python values into PHP arguments and call the function.
+   Returns the converted return value. */
+static PyObject *
+Function_call_items(Function *self, PyObject **items, int argc TSRMLS_DC)
+{
+	zval *stack_argv[FUNCTION_STACK_ARGS], **stack_params[FUNCTION_STACK_ARGS];
+	zval **argv = stack_argv, ***params = stack_params, *ret = NULL;
+	PyObject *result = NULL;
+	int i, n;
+
+	if (argc > FUNCTION_STACK_ARGS) {
+		argv = emalloc(sizeof(zval *) * argc);
+		params = emalloc(sizeof(zval **) * argc);
+	}
+
+	for (n = 0; n < argc; ++n) {
+		ALLOC_INIT_ZVAL(argv[n]);
+		params[n] = &argv[n];
+
+		if (pip_pyobject_to_zval(items[n], argv[n] TSRMLS_CC) != SUCCESS) {
+			PyErr_Format(PyExc_ValueError, "Bad argument at index %d", n);
+			++n;
+			break;
+		}
+	}
+
+	if (!PyErr_Occurred())
+		ret = Function_invoke(self, params, argc TSRMLS_CC);
 
 	for (i = 0; i < n; ++i)
-		efree(p[i]);
+		zval_ptr_dtor(&argv[i]);
 
-	efree(p);
+	if (argv != stack_argv) {
+		efree(argv);
+		efree(params);
+	}
+
+	/* Convert the return value now that we hold the thread state again. */
+	if (ret) {
+		result = pip_zval_to_pyobject(ret TSRMLS_CC);
+		zval_ptr_dtor(&ret);
+	}
+
+	return result;
 }
 /* }}} */
+/* {{{ Function_call_many
+   Call the function once for each item of the iterable and return a list
+   of the results.  A tuple item holds the arguments for one call; any
+   other item is passed as the only argument.  The argument zvals are
+   reused from one call to the next. */
+static PyObject *
+Function_call_many(Function *self, PyObject *iterable TSRMLS_DC)
+{
+	zval *stack_argv[FUNCTION_STACK_ARGS], **stack_params[FUNCTION_STACK_ARGS];
+	zval **argv = stack_argv, ***params = stack_params, *ret;
+	PyObject *iter, *item, *results, *result, **items;
+	int size = FUNCTION_STACK_ARGS, used = 0, argc, i, status = SUCCESS;
 
-/* {{{ php_call
+	iter = PyObject_GetIter(iterable);
+	if (iter == NULL)
+		return NULL;
+
+	results = PyList_New(0);
+	if (results == NULL) {
+		Py_DECREF(iter);
+		return NULL;
+	}
+
+	while (status == SUCCESS && (item = PyIter_Next(iter)) != NULL) {
+		if (PyTuple_Check(item)) {
+			items = &PyTuple_GET_ITEM(item, 0);
+			argc = PyTuple_GET_SIZE(item);
+		} else {
+			items = &item;
+			argc = 1;
+		}
+
+		if (argc > size) {
+			if (argv == stack_argv) {
+				argv = emalloc(sizeof(zval *) * argc);
+				params = emalloc(sizeof(zval **) * argc);
+				memcpy(argv, stack_argv, sizeof(zval *) * used);
+			} else {
+				argv = erealloc(argv, sizeof(zval *) * argc);
+				params = erealloc(params, sizeof(zval **) * argc);
+			}
+			size = argc;
+		}
+
+		for (; used < argc; ++used)
+			ALLOC_INIT_ZVAL(argv[used]);
+
+		for (i = 0; i < argc; ++i) {
+			/* Reuse the slot, unless the last call kept a reference to it. */
+			if (Z_REFCOUNT_P(argv[i]) > 1) {
+				zval_ptr_dtor(&argv[i]);
+				ALLOC_ZVAL(argv[i]);
+			} else
+				zval_dtor(argv[i]);
+			INIT_PZVAL(argv[i]);
+			ZVAL_NULL(argv[i]);
+			params[i] = &argv[i];
+
+			if (pip_pyobject_to_zval(items[i], argv[i] TSRMLS_CC) != SUCCESS) {
+				PyErr_Format(PyExc_ValueError, "Bad argument at index %d", i);
+				status = FAILURE;
+				break;
+			}
+		}
+
+		Py_DECREF(item);
+
+		if (status == FAILURE)
+			break;
+
+		ret = Function_invoke(self, params, argc TSRMLS_CC);
+		if (ret == NULL) {
+			status = FAILURE;
+			break;
+		}
+
+		result = pip_zval_to_pyobject(ret TSRMLS_CC);
+		zval_ptr_dtor(&ret);
+
+		if (result == NULL || PyList_Append(results, result) == -1)
+			status = FAILURE;
+		Py_XDECREF(result);
+	}
+
+	for (i = 0; i < used; ++i)
+		zval_ptr_dtor(&argv[i]);
+
+	if (argv != stack_argv) {
+		efree(argv);
+		efree(params);
+	}
+
+	Py_DECREF(iter);
+
+	if (status == FAILURE || PyErr_Occurred())
+		Py_CLEAR(results);
+
+	return results;
+}
+/* }}} */
+/* {{{ Function_dealloc
+ */
+static void
+Function_dealloc(Function *self)
+{
+	TSRMLS_FETCH();
+
+	/*
+	 * PHP values can only be released on the request's thread.  Anywhere
+	 * else, they are deliberately leaked: PHP's memory manager discards
+	 * them when the request ends, although debug builds report them.
+	 */
+	if (PyThreadState_GET() == PYG(tstate)) {
+		if (self->callable)
+			zval_ptr_dtor(&self->callable);
+		if (self->name)
+			efree(self->name);
+	}
+
+	PyObject_Del(self);
+}
+/* }}} */
+/* {{{ Function_repr
  */
 static PyObject *
-php_call(PyObject *self, PyObject *args)
+Function_repr(Function *self)
+{
+	return PyString_FromFormat("<php.Function %s>", self->name);
+}
+/* }}} */
+/* {{{ Function_call
+ */
+static PyObject *
+Function_call(Function *self, PyObject *args, PyObject *kwds)
 {
-	const char *name;
-	int name_len, i, argc;
-	zval ***argv, *lcname, *ret;
-	PyObject *params = NULL;
+	TSRMLS_FETCH();
+
+	if (php_check_thread(TSRMLS_C) == FAILURE)
+		return NULL;
+
+	if (kwds && PyDict_Size(kwds) > 0) {
+		PyErr_SetString(PyExc_TypeError,
+						"PHP functions don't accept keyword arguments");
+		return NULL;
+	}
 
+	return Function_call_items(self, &PyTuple_GET_ITEM(args, 0),
+							   PyTuple_GET_SIZE(args) TSRMLS_CC);
+}
+/* }}} */
+/* {{{ Function_Type
+ */
+static PyTypeObject Function_Type = {
+	PyObject_HEAD_INIT(NULL)
+	0,													/* ob_size */
+	"php.Function",										/* tp_name */
+	sizeof(Function),									/* tp_basicsize */
+	0,													/* tp_itemsize */
+	(destructor)Function_dealloc,						/* tp_dealloc */
+	0,													/* tp_print */
+	0,													/* tp_getattr */
+	0,													/* tp_setattr */
+	0,													/* tp_compare */
+	(reprfunc)Function_repr,							/* tp_repr */
+	0,													/* tp_as_number */
+	0,													/* tp_as_sequence */
+	0,													/* tp_as_mapping */
+	0,													/* tp_hash */
+	(ternaryfunc)Function_call,							/* tp_call */
+	0,													/* tp_str */
+	0,													/* tp_getattro */
+	0,													/* tp_setattro */
+	0,													/* tp_as_buffer */
+	Py_TPFLAGS_DEFAULT,									/* tp_flags */
+	"PHP Function",										/* tp_doc */
+};
+/* }}} */
+/* }}} */
+
+/* {{{ PyObject *python_function_new(zval *callable TSRMLS_DC)
+   Resolve a PHP callable into a php.Function object.  Returns NULL with a
+   Python exception set if it isn't callable. */
+PyObject *
+python_function_new(zval *callable TSRMLS_DC)
+{
+	Function *self;
+	char *error = NULL;
+
+	self = PyObject_New(Function, &Function_Type);
+	if (self == NULL)
+		return NULL;
+
+	/* The function info refers to our own copy of the callable. */
+	MAKE_STD_ZVAL(self->callable);
+	*self->callable = *callable;
+	zval_copy_ctor(self->callable);
+	INIT_PZVAL(self->callable);
+	self->name = NULL;
+
+	if (zend_fcall_info_init(self->callable, 0, &self->fci, &self->fcc,
+							 &self->name, &error TSRMLS_CC) == FAILURE) {
+		if (Z_TYPE_P(callable) == IS_STRING)
+			PyErr_Format(PyExc_NameError, "Function does not exist: %s",
+						 Z_STRVAL_P(callable));
+		else
+			PyErr_Format(PyExc_TypeError, "Not a PHP callable: %s",
+						 self->name ? self->name : "(unknown)");
+		if (error)
+			efree(error);
+		Py_DECREF(self);
+		return NULL;
+	}
+
+	if (error)
+		efree(error);
+
+	return (PyObject *)self;
+}
+/* }}} */
+/* {{{ zval *python_function_callable(PyObject *o)
+   Return the PHP callable a php.Function object was created from, or NULL
+   if the object isn't a php.Function. */
+zval *
+python_function_callable(PyObject *o)
+{
+	if (!PyObject_TypeCheck(o, &Function_Type))
+		return NULL;
+
+	return ((Function *)o)->callable;
+}
+/* }}} */
+/* {{{ php_function_lookup
+   Find the php.Function for the given name in the request's cache,
+   resolving and caching it on first use.  Returns a borrowed reference. */
+static PyObject *
+php_function_lookup(PyObject *name TSRMLS_DC)
+{
+	PyObject *function;
+	zval zname;
+
+	if (!PyString_Check(name)) {
+		PyErr_SetString(PyExc_TypeError, "Function name must be a string");
+		return NULL;
+	}
+
+	if (PYG(functions) == NULL && (PYG(functions) = PyDict_New()) == NULL)
+		return NULL;
+
+	function = PyDict_GetItem(PYG(functions), name);
+	if (function)
+		return function;
+
+	INIT_ZVAL(zname);
+	ZVAL_STRINGL(&zname, PyString_AS_STRING(name), PyString_GET_SIZE(name), 0);
+
+	function = python_function_new(&zname TSRMLS_CC);
+	if (function == NULL)
+		return NULL;
+
+	if (PyDict_SetItem(PYG(functions), name, function) == -1) {
+		Py_DECREF(function);
+		return NULL;
+	}
+
+	Py_DECREF(function);
+
+	return function;
+}
+/* }}} */
+
+/* {{{ Array
+ */
+typedef struct {
+	PyObject_HEAD
+	zval *		array;
+} Array;
+
+static PyTypeObject Array_Type;
+
+/*
+ * An Array is a read-only mapping over a PHP array.  It holds a reference
+ * to the array's zval, so PHP's copy-on-write semantics leave it looking at
+ * the array as it was when it was looked up.  A reference is written in
+ * place instead, so an Array takes a private copy of one.  Elements are
+ * converted one at a time, when they are looked up, and nested arrays
+ * become Arrays in turn.
+ */
+
+/* {{{ Array_value
+   Convert a PHP value for Python, wrapping arrays in a new Array rather
+   than converting them.  Returns a new reference. */
+static PyObject *
+Array_value(zval *value TSRMLS_DC)
+{
+	Array *self;
+
+	if (Z_TYPE_P(value) != IS_ARRAY || pip_zval_is_callable(value TSRMLS_CC))
+		return pip_zval_to_pyobject(value TSRMLS_CC);
+
+	self = PyObject_New(Array, &Array_Type);
+	if (self == NULL)
+		return NULL;
+
+	if (PZVAL_IS_REF(value)) {
+		MAKE_STD_ZVAL(self->array);
+		*self->array = *value;
+		zval_copy_ctor(self->array);
+		INIT_PZVAL(self->array);
+	} else {
+		Z_ADDREF_P(value);
+		self->array = value;
+	}
+
+	return (PyObject *)self;
+}
+/* }}} */
+/* {{{ Array_find
+   Look up the element for a Python key, which must be a string or an
+   integer.  Returns FAILURE, with a KeyError set, if there is none. */
+static int
+Array_find(Array *self, PyObject *key, zval ***value TSRMLS_DC)
+{
+	HashTable *ht = Z_ARRVAL_P(self->array);
+	long index;
+
+	if (PyString_Check(key)) {
+		if (zend_symtable_find(ht, PyString_AS_STRING(key),
+							   PyString_GET_SIZE(key) + 1,
+							   (void **)value) == SUCCESS)
+			return SUCCESS;
+	} else if (PyInt_Check(key) || PyLong_Check(key)) {
+		index = PyInt_AsLong(key);
+		if (index == -1 && PyErr_Occurred())
+			return FAILURE;
+		if (zend_hash_index_find(ht, index, (void **)value) == SUCCESS)
+			return SUCCESS;
+	} else {
+		PyErr_SetString(PyExc_TypeError, "Array keys must be strings or integers");
+		return FAILURE;
+	}
+
+	PyErr_SetObject(PyExc_KeyError, key);
+	return FAILURE;
+}
+/* }}} */
+/* {{{ Array_dealloc
+ */
+static void
+Array_dealloc(Array *self)
+{
 	TSRMLS_FETCH();
 
-	if (!PyArg_ParseTuple(args, "s#|O:call", &name, &name_len, &params))
+	/* As in Function_dealloc(), the array is leaked on other threads. */
+	if (PyThreadState_GET() == PYG(tstate))
+		zval_ptr_dtor(&self->array);
+
+	PyObject_Del(self);
+}
+/* }}} */
+/* {{{ Array_keys
+ */
+static PyObject *
+Array_keys(Array *self, PyObject *args)
+{
+	HashTable *ht;
+	HashPosition pos;
+	PyObject *keys, *key;
+	char *name;
+	uint len;
+	ulong index;
+	int type;
+	TSRMLS_FETCH();
+
+	if (php_check_thread(TSRMLS_C) == FAILURE)
 		return NULL;
 
-	if (params && !PySequence_Check(params)) {
-		PyErr_Format(PyExc_ValueError, "Second argument must be a sequence");
+	ht = Z_ARRVAL_P(self->array);
+
+	keys = PyList_New(0);
+	if (keys == NULL)
 		return NULL;
+
+	for (zend_hash_internal_pointer_reset_ex(ht, &pos);
+		 (type = zend_hash_get_current_key_ex(ht, &name, &len, &index, 0, &pos)) != HASH_KEY_NON_EXISTANT;
+		 zend_hash_move_forward_ex(ht, &pos)) {
+		if (type == HASH_KEY_IS_STRING)
+			key = PyString_FromStringAndSize(name, len - 1);
+		else
+			key = PyInt_FromLong((long)index);
+		if (key == NULL || PyList_Append(keys, key) == -1) {
+			Py_XDECREF(key);
+			Py_DECREF(keys);
+			return NULL;
+		}
+		Py_DECREF(key);
 	}
 
-	/* Name entries in the PHP function_table are always lowercased. */
-	MAKE_STD_ZVAL(lcname);
-	ZVAL_STRINGL(lcname, (char *)name, name_len, 1);
-	zend_str_tolower(Z_STRVAL_P(lcname), name_len);
+	return keys;
+}
+/* }}} */
+/* {{{ Array_length
+ */
+static Py_ssize_t
+Array_length(Array *self)
+{
+	TSRMLS_FETCH();
+
+	if (php_check_thread(TSRMLS_C) == FAILURE)
+		return -1;
+
+	return zend_hash_num_elements(Z_ARRVAL_P(self->array));
+}
+/* }}} */
+/* {{{ Array_subscript
+ */
+static PyObject *
+Array_subscript(Array *self, PyObject *key)
+{
+	zval **value;
+	TSRMLS_FETCH();
+
+	if (php_check_thread(TSRMLS_C) == FAILURE)
+		return NULL;
+
+	if (Array_find(self, key, &value TSRMLS_CC) == FAILURE)
+		return NULL;
+
+	return Array_value(*value TSRMLS_CC);
+}
+/* }}} */
+/* {{{ Array_contains
+ */
+static int
+Array_contains(Array *self, PyObject *key)
+{
+	zval **value;
+	TSRMLS_FETCH();
+
+	if (php_check_thread(TSRMLS_C) == FAILURE)
+		return -1;
+
+	if (Array_find(self, key, &value TSRMLS_CC) == FAILURE) {
+		if (!PyErr_ExceptionMatches(PyExc_KeyError))
+			return -1;
+		PyErr_Clear();
+		return 0;
+	}
+
+	return 1;
+}
+/* }}} */
+/* {{{ Array_get
+ */
+static PyObject *
+Array_get(Array *self, PyObject *args)
+{
+	PyObject *key, *def = Py_None, *value;
+
+	if (!PyArg_ParseTuple(args, "O|O:get", &key, &def))
+		return NULL;
+
+	value = Array_subscript(self, key);
+	if (value == NULL && PyErr_ExceptionMatches(PyExc_KeyError)) {
+		PyErr_Clear();
+		Py_INCREF(def);
+		value = def;
+	}
+
+	return value;
+}
+/* }}} */
+/* {{{ Array_copy
+   Convert the whole array into a Python dictionary. */
+static PyObject *
+Array_copy(Array *self, PyObject *args)
+{
+	TSRMLS_FETCH();
+
+	if (php_check_thread(TSRMLS_C) == FAILURE)
+		return NULL;
+
+	return pip_hash_to_dict(self->array TSRMLS_CC);
+}
+/* }}} */
+/* {{{ Array_iter
+ */
+static PyObject *
+Array_iter(Array *self)
+{
+	PyObject *keys, *iter;
+
+	keys = Array_keys(self, NULL);
+	if (keys == NULL)
+		return NULL;
+
+	iter = PyObject_GetIter(keys);
+	Py_DECREF(keys);
 
-	/* If this isn't a valid PHP function name, we cannot proceed. */
-	if (!zend_hash_exists(CG(function_table), Z_STRVAL_P(lcname), name_len+1)) {
-		PyErr_Format(PyExc_NameError, "Function does not exist: %s",
-					 Z_STRVAL_P(lcname));
+	return iter;
+}
+/* }}} */
+/* {{{ Array_repr
+ */
+static PyObject *
+Array_repr(Array *self)
+{
+	return PyString_FromFormat("<php.Array of %d elements>",
+							   zend_hash_num_elements(Z_ARRVAL_P(self->array)));
+}
+/* }}} */
+
+/* {{{ Array_methods
+ */
+static PyMethodDef Array_methods[] = {
+	{ "copy",		(PyCFunction)Array_copy,		METH_NOARGS, 0 },
+	{ "get",		(PyCFunction)Array_get,			METH_VARARGS, 0 },
+	{ "keys",		(PyCFunction)Array_keys,		METH_NOARGS, 0 },
+	{ NULL, NULL}
+};
+/* }}} */
+/* {{{ Array_as_sequence
+ */
+static PySequenceMethods Array_as_sequence = {
+	0,													/* sq_length */
+	0,													/* sq_concat */
+	0,													/* sq_repeat */
+	0,													/* sq_item */
+	0,													/* sq_slice */
+	0,													/* sq_ass_item */
+	0,													/* sq_ass_slice */
+	(objobjproc)Array_contains,							/* sq_contains */
+};
+/* }}} */
+/* {{{ Array_as_mapping
+ */
+static PyMappingMethods Array_as_mapping = {
+	(lenfunc)Array_length,								/* mp_length */
+	(binaryfunc)Array_subscript,						/* mp_subscript */
+	0,													/* mp_ass_subscript */
+};
+/* }}} */
+/* {{{ Array_Type
+ */
+static PyTypeObject Array_Type = {
+	PyObject_HEAD_INIT(NULL)
+	0,													/* ob_size */
+	"php.Array",										/* tp_name */
+	sizeof(Array),										/* tp_basicsize */
+	0,													/* tp_itemsize */
+	(destructor)Array_dealloc,							/* tp_dealloc */
+	0,													/* tp_print */
+	0,													/* tp_getattr */
+	0,													/* tp_setattr */
+	0,													/* tp_compare */
+	(reprfunc)Array_repr,								/* tp_repr */
+	0,													/* tp_as_number */
+	&Array_as_sequence,									/* tp_as_sequence */
+	&Array_as_mapping,									/* tp_as_mapping */
+	0,													/* tp_hash */
+	0,													/* tp_call */
+	0,													/* tp_str */
+	0,													/* tp_getattro */
+	0,													/* tp_setattro */
+	0,													/* tp_as_buffer */
+	Py_TPFLAGS_DEFAULT,									/* tp_flags */
+	"PHP Array",										/* tp_doc */
+	0,													/* tp_traverse */
+	0,													/* tp_clear */
+	0,													/* tp_richcompare */
+	0,													/* tp_weaklistoffset */
+	(getiterfunc)Array_iter,							/* tp_iter */
+	0,													/* tp_iternext */
+	Array_methods,										/* tp_methods */
+};
+/* }}} */
+/* }}} */
+/* {{{ zval *python_array_zval(PyObject *o)
+   Return the PHP array a php.Array object refers to, or NULL if the object
+   isn't a php.Array. */
+zval *
+python_array_zval(PyObject *o)
+{
+	if (!PyObject_TypeCheck(o, &Array_Type))
 		return NULL;
+
+	return ((Array *)o)->array;
+}
+/* }}} */
+
+/* {{{ SymbolTable
+ */
+typedef struct {
+	PyObject_HEAD
+	int			superglobals;
+} SymbolTable;
+
+static PyTypeObject SymbolTable_Type;
+
+/*
+ * php.globals and php.request are mappings over PHP's global symbol table.
+ * Nothing is converted up front: each lookup converts just the variable it
+ * asks for, arrays are returned as php.Array mappings, and assignments are
+ * converted back and stored in the symbol table.  php.request only exposes
+ * the auto globals ($_GET, $_SERVER and so on), which are created on first
+ * use if PHP defers them.
+ */
+
+/* {{{ SymbolTable_key
+   Check that the key names a variable this mapping exposes.  Returns
+   FAILURE with a Python exception set if it doesn't. */
+static int
+SymbolTable_key(SymbolTable *self, PyObject *key, char **name, int *len TSRMLS_DC)
+{
+	if (php_check_thread(TSRMLS_C) == FAILURE)
+		return FAILURE;
+
+	if (!PyString_Check(key)) {
+		PyErr_SetString(PyExc_TypeError, "Variable names must be strings");
+		return FAILURE;
 	}
 
-	/* Convert the parameters into PHP values. */
-	argc = params ? PySequence_Size(params) : 0;
-	argv = emalloc(sizeof(zval **) * argc);
+	*name = PyString_AS_STRING(key);
+	*len = PyString_GET_SIZE(key);
+
+	if (self->superglobals && !zend_is_auto_global(*name, *len TSRMLS_CC)) {
+		PyErr_SetObject(PyExc_KeyError, key);
+		return FAILURE;
+	}
+
+	return SUCCESS;
+}
+/* }}} */
+/* {{{ SymbolTable_keys
+ */
+static PyObject *
+SymbolTable_keys(SymbolTable *self, PyObject *args)
+{
+	HashTable *ht;
+	HashPosition pos;
+	PyObject *keys, *key;
+	char *name;
+	uint len;
+	ulong index;
+	int type;
+	TSRMLS_FETCH();
+
+	if (php_check_thread(TSRMLS_C) == FAILURE)
+		return NULL;
 
-	for (i = 0; i < argc; ++i) {
-		PyObject *item = PySequence_GetItem(params, i);
+	keys = PyList_New(0);
+	if (keys == NULL)
+		return NULL;
 
-		argv[i] = emalloc(sizeof(zval *));
-		MAKE_STD_ZVAL(*argv[i]);
+	ht = self->superglobals ? CG(auto_globals) : &EG(symbol_table);
 
-		if (pip_pyobject_to_zval(item, *argv[i] TSRMLS_CC) != SUCCESS) {
-			PyErr_Format(PyExc_ValueError, "Bad argument at index %d", i);
-			Py_DECREF(item);
-			efree_array(argv, i + 1);
+	/* Integer keys can't be variable names, so they are skipped. */
+	for (zend_hash_internal_pointer_reset_ex(ht, &pos);
+		 (type = zend_hash_get_current_key_ex(ht, &name, &len, &index, 0, &pos)) != HASH_KEY_NON_EXISTANT;
+		 zend_hash_move_forward_ex(ht, &pos)) {
+		if (type != HASH_KEY_IS_STRING)
+			continue;
+		key = PyString_FromStringAndSize(name, len - 1);
+		if (key == NULL || PyList_Append(keys, key) == -1) {
+			Py_XDECREF(key);
+			Py_DECREF(keys);
 			return NULL;
 		}
+		Py_DECREF(key);
+	}
 
-		Py_DECREF(item);
+	return keys;
+}
+/* }}} */
+/* {{{ SymbolTable_length
+ */
+static Py_ssize_t
+SymbolTable_length(SymbolTable *self)
+{
+	TSRMLS_FETCH();
+
+	if (php_check_thread(TSRMLS_C) == FAILURE)
+		return -1;
+
+	if (self->superglobals)
+		return zend_hash_num_elements(CG(auto_globals));
+
+	return zend_hash_num_elements(&EG(symbol_table));
+}
+/* }}} */
+/* {{{ SymbolTable_subscript
+ */
+static PyObject *
+SymbolTable_subscript(SymbolTable *self, PyObject *key)
+{
+	zval **value;
+	char *name;
+	int len;
+	TSRMLS_FETCH();
+
+	if (SymbolTable_key(self, key, &name, &len TSRMLS_CC) == FAILURE)
+		return NULL;
+
+	if (zend_hash_find(&EG(symbol_table), name, len + 1, (void **)&value) != SUCCESS) {
+		PyErr_SetObject(PyExc_KeyError, key);
+		return NULL;
 	}
 
-	/* Now we can call the PHP function. */
-	if (call_user_function_ex(CG(function_table), (zval **)NULL, lcname, &ret,
-							  argc, argv, 0, NULL TSRMLS_CC) != SUCCESS) {
-		PyErr_Format(PyExc_Exception, "Failed to execute function: %s",
-					 Z_STRVAL_P(lcname));
-		efree_array(argv, argc);
+	return Array_value(*value TSRMLS_CC);
+}
+/* }}} */
+/* {{{ SymbolTable_ass_subscript
+ */
+static int
+SymbolTable_ass_subscript(SymbolTable *self, PyObject *key, PyObject *v)
+{
+	zval **slot, *value;
+	char *name;
+	int len;
+	TSRMLS_FETCH();
+
+	if (SymbolTable_key(self, key, &name, &len TSRMLS_CC) == FAILURE)
+		return -1;
+
+	if (v == NULL) {
+		if (self->superglobals) {
+			PyErr_SetString(PyExc_TypeError, "Superglobals cannot be deleted");
+			return -1;
+		}
+		if (zend_hash_del(&EG(symbol_table), name, len + 1) != SUCCESS) {
+			PyErr_SetObject(PyExc_KeyError, key);
+			return -1;
+		}
+		return 0;
+	}
+
+	ALLOC_INIT_ZVAL(value);
+	if (pip_pyobject_to_zval(v, value TSRMLS_CC) != SUCCESS) {
+		zval_ptr_dtor(&value);
+		if (!PyErr_Occurred())
+			PyErr_SetString(PyExc_ValueError, "Value cannot be converted to PHP");
+		return -1;
+	}
+
+	/* Assign through a reference, as PHP would, so that it stays bound. */
+	if (zend_hash_find(&EG(symbol_table), name, len + 1, (void **)&slot) == SUCCESS &&
+		PZVAL_IS_REF(*slot)) {
+		zend_uint refcount = Z_REFCOUNT_P(*slot);
+
+		zval_dtor(*slot);
+		**slot = *value;
+		Z_SET_REFCOUNT_P(*slot, refcount);
+		Z_SET_ISREF_P(*slot);
+		FREE_ZVAL(value);
+		return 0;
+	}
+
+	zend_hash_update(&EG(symbol_table), name, len + 1, &value, sizeof(zval *), NULL);
+
+	return 0;
+}
+/* }}} */
+/* {{{ SymbolTable_contains
+ */
+static int
+SymbolTable_contains(SymbolTable *self, PyObject *key)
+{
+	char *name;
+	int len;
+	TSRMLS_FETCH();
+
+	if (SymbolTable_key(self, key, &name, &len TSRMLS_CC) == FAILURE) {
+		if (!PyErr_ExceptionMatches(PyExc_KeyError))
+			return -1;
+		PyErr_Clear();
+		return 0;
+	}
+
+	return zend_hash_exists(&EG(symbol_table), name, len + 1);
+}
+/* }}} */
+/* {{{ SymbolTable_get
+ */
+static PyObject *
+SymbolTable_get(SymbolTable *self, PyObject *args)
+{
+	PyObject *key, *def = Py_None, *value;
+
+	if (!PyArg_ParseTuple(args, "O|O:get", &key, &def))
 		return NULL;
+
+	value = SymbolTable_subscript(self, key);
+	if (value == NULL && PyErr_ExceptionMatches(PyExc_KeyError)) {
+		PyErr_Clear();
+		Py_INCREF(def);
+		value = def;
 	}
 
-	efree_array(argv, argc);
+	return value;
+}
+/* }}} */
+/* {{{ SymbolTable_iter
+ */
+static PyObject *
+SymbolTable_iter(SymbolTable *self)
+{
+	PyObject *keys, *iter;
+
+	keys = SymbolTable_keys(self, NULL);
+	if (keys == NULL)
+		return NULL;
+
+	iter = PyObject_GetIter(keys);
+	Py_DECREF(keys);
 
-	return pip_zval_to_pyobject(ret TSRMLS_CC);
+	return iter;
+}
+/* }}} */
+
+/* {{{ SymbolTable_methods
+ */
+static PyMethodDef SymbolTable_methods[] = {
+	{ "get",		(PyCFunction)SymbolTable_get,		METH_VARARGS, 0 },
+	{ "keys",		(PyCFunction)SymbolTable_keys,		METH_NOARGS, 0 },
+	{ NULL, NULL}
+};
+/* }}} */
+/* {{{ SymbolTable_as_sequence
+ */
+static PySequenceMethods SymbolTable_as_sequence = {
+	0,													/* sq_length */
+	0,													/* sq_concat */
+	0,													/* sq_repeat */
+	0,													/* sq_item */
+	0,													/* sq_slice */
+	0,													/* sq_ass_item */
+	0,													/* sq_ass_slice */
+	(objobjproc)SymbolTable_contains,					/* sq_contains */
+};
+/* }}} */
+/* {{{ SymbolTable_as_mapping
+ */
+static PyMappingMethods SymbolTable_as_mapping = {
+	(lenfunc)SymbolTable_length,						/* mp_length */
+	(binaryfunc)SymbolTable_subscript,					/* mp_subscript */
+	(objobjargproc)SymbolTable_ass_subscript,			/* mp_ass_subscript */
+};
+/* }}} */
+/* {{{ SymbolTable_Type
+ */
+static PyTypeObject SymbolTable_Type = {
+	PyObject_HEAD_INIT(NULL)
+	0,													/* ob_size */
+	"php.SymbolTable",									/* tp_name */
+	sizeof(SymbolTable),								/* tp_basicsize */
+	0,													/* tp_itemsize */
+	(destructor)PyObject_Del,							/* tp_dealloc */
+	0,													/* tp_print */
+	0,													/* tp_getattr */
+	0,													/* tp_setattr */
+	0,													/* tp_compare */
+	0,													/* tp_repr */
+	0,													/* tp_as_number */
+	&SymbolTable_as_sequence,							/* tp_as_sequence */
+	&SymbolTable_as_mapping,							/* tp_as_mapping */
+	0,													/* tp_hash */
+	0,													/* tp_call */
+	0,													/* tp_str */
+	0,													/* tp_getattro */
+	0,													/* tp_setattro */
+	0,													/* tp_as_buffer */
+	Py_TPFLAGS_DEFAULT,									/* tp_flags */
+	"PHP Symbol Table",									/* tp_doc */
+	0,													/* tp_traverse */
+	0,													/* tp_clear */
+	0,													/* tp_richcompare */
+	0,													/* tp_weaklistoffset */
+	(getiterfunc)SymbolTable_iter,						/* tp_iter */
+	0,													/* tp_iternext */
+	SymbolTable_methods,								/* tp_methods */
+};
+/* }}} */
+/* }}} */
+
+/* {{{ php_call
+ */
+static PyObject *
+php_call(PyObject *self, PyObject *args)
+{
+	PyObject *name, *params = NULL, *function, *seq, *result;
+	TSRMLS_FETCH();
+
+	if (php_check_thread(TSRMLS_C) == FAILURE)
+		return NULL;
+
+	if (!PyArg_ParseTuple(args, "O|O:call", &name, &params))
+		return NULL;
+
+	if (params && !PySequence_Check(params)) {
+		PyErr_Format(PyExc_ValueError, "Second argument must be a sequence");
+		return NULL;
+	}
+
+	function = php_function_lookup(name TSRMLS_CC);
+	if (function == NULL)
+		return NULL;
+
+	if (params == NULL)
+		return Function_call_items((Function *)function, NULL, 0 TSRMLS_CC);
+
+	seq = PySequence_Fast(params, "Second argument must be a sequence");
+	if (seq == NULL)
+		return NULL;
+
+	result = Function_call_items((Function *)function,
+								 PySequence_Fast_ITEMS(seq),
+								 PySequence_Fast_GET_SIZE(seq) TSRMLS_CC);
+	Py_DECREF(seq);
+
+	return result;
+}
+/* }}} */
+/* {{{ php_call_many
+ */
+static PyObject *
+php_call_many(PyObject *self, PyObject *args)
+{
+	PyObject *name, *iterable, *function;
+	TSRMLS_FETCH();
+
+	if (php_check_thread(TSRMLS_C) == FAILURE)
+		return NULL;
+
+	if (!PyArg_ParseTuple(args, "OO:call_many", &name, &iterable))
+		return NULL;
+
+	/* The function can be given by name or as a php.Function. */
+	if (PyObject_TypeCheck(name, &Function_Type))
+		function = name;
+	else if ((function = php_function_lookup(name TSRMLS_CC)) == NULL)
+		return NULL;
+
+	return Function_call_many((Function *)function, iterable TSRMLS_CC);
+}
+/* }}} */
+/* {{{ php_function
+ */
+static PyObject *
+php_function(PyObject *self, PyObject *args)
+{
+	PyObject *name, *function;
+	TSRMLS_FETCH();
+
+	if (php_check_thread(TSRMLS_C) == FAILURE)
+		return NULL;
+
+	if (!PyArg_ParseTuple(args, "O:function", &name))
+		return NULL;
+
+	function = php_function_lookup(name TSRMLS_CC);
+	Py_XINCREF(function);
+
+	return function;
 }
 /* }}} */
 /* {{{ php_var
@@ -118,6 +1127,9 @@ php_var(PyObject *self, PyObject *args)
 
 	TSRMLS_FETCH();
 
+	if (php_check_thread(TSRMLS_C) == FAILURE)
+		return NULL;
+
 	if (!PyArg_ParseTuple(args, "s#", &name, &len))
 		return NULL;
 
@@ -142,17 +1154,63 @@ php_version(PyObject *self, PyObject *args)
  */
 static PyMethodDef python_php_methods[] = {
 	{"call",			php_call,			METH_VARARGS},
+	{"call_many",		php_call_many,		METH_VARARGS},
+	{"function",		php_function,		METH_VARARGS},
 	{"var",				php_var,			METH_VARARGS},
 	{"version",			php_version,		METH_NOARGS},
 	{NULL, NULL, 0, NULL}
 };
 /* }}} */
+/* {{{ void python_php_shutdown(TSRMLS_D)
+   Release the request's cache of resolved PHP functions. */
+void
+python_php_shutdown(TSRMLS_D)
+{
+	Py_CLEAR(PYG(functions));
+}
+/* }}} */
 /* {{{ int python_php_init()
  */
 int
 python_php_init()
 {
-	if (Py_InitModule3("php", python_php_methods, "PHP Module") == NULL)
+	PyObject *module;
+	SymbolTable *symbols;
+	int i;
+
+	module = Py_InitModule3("php", python_php_methods, "PHP Module");
+	if (module == NULL)
+		return FAILURE;
+
+	if (PyType_Ready(&Function_Type) == -1)
+		return FAILURE;
+
+	Py_INCREF(&Function_Type);
+	if (PyModule_AddObject(module, "Function", (PyObject *)&Function_Type) == -1)
+		return FAILURE;
+
+	if (PyType_Ready(&Array_Type) == -1)
+		return FAILURE;
+
+	Py_INCREF(&Array_Type);
+	if (PyModule_AddObject(module, "Array", (PyObject *)&Array_Type) == -1)
+		return FAILURE;
+
+	if (PyType_Ready(&SymbolTable_Type) == -1)
+		return FAILURE;
+
+	for (i = 0; i < 2; ++i) {
+		symbols = PyObject_New(SymbolTable, &SymbolTable_Type);
+		if (symbols == NULL)
+			return FAILURE;
+
+		symbols->superglobals = i;
+		if (PyModule_AddObject(module, i ? "request" : "globals",
+							   (PyObject *)symbols) == -1)
+			return FAILURE;
+	}
+
+	if (python_streams_register(module) == FAILURE)
 		return FAILURE;
 
 	return SUCCESS;
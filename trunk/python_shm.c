@@ -0,0 +1,327 @@
+/*
+ * Python in PHP - Embedded Python Extension
+ *
+ * Copyright (c) 2003,2004,2005,2006,2007,2008 Jon Parise <jon@php.net>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * $Id$
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "php_python_internal.h"
+#include "marshal.h"
+
+#ifndef PHP_WIN32
+#include <sys/mman.h>
+#include <errno.h>
+#include <pthread.h>
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/*
+ * The shared code cache is a single anonymous, shared memory mapping that is
+ * created during module startup, before the SAPI forks its worker processes,
+ * and is therefore inherited by all of them.  It is laid out as a fixed
+ * header, followed by an open-addressed table of slots, followed by a data
+ * area from which keys and marshalled code objects are allocated.
+ *
+ * Entries are never modified or removed once they have been published.
+ * When the data area or the slot table fills up, new code objects simply
+ * aren't stored anymore.  This keeps readers simple: the lock only needs to
+ * be held while searching or updating the slot table, and the marshalled
+ * data can be read after it has been released.
+ *
+ * A worker process can die while holding the lock (it may crash, or be
+ * killed for running too long).  Where robust mutexes are available, the
+ * next process to take the lock recovers it instead of waiting forever.
+ * The table is always left consistent for it: an entry's space is claimed
+ * before the slot is filled in, and the slot's data length, which marks it
+ * as used, is written last.
+ */
+
+/* {{{ python_shm_slot
+ */
+typedef struct _python_shm_slot {
+	ulong				h;				/* hash value of the key */
+	size_t				key_offset;		/* offset of the key in the segment */
+	size_t				key_len;
+	size_t				data_offset;	/* offset of the marshalled data */
+	size_t				data_len;		/* zero for an unused slot */
+} python_shm_slot;
+/* }}} */
+/* {{{ python_shm_header
+ */
+typedef struct _python_shm_header {
+	pthread_mutex_t		lock;
+	size_t				size;			/* total size of the segment */
+	size_t				used;			/* bytes allocated so far */
+	ulong				nslots;			/* number of slots (a power of 2) */
+	ulong				count;			/* number of used slots */
+	python_shm_slot		slots[1];
+} python_shm_header;
+/* }}} */
+
+static python_shm_header *shm = NULL;
+
+/* {{{ shm_lock()
+   Take the segment's lock, recovering it if its owner died holding it. */
+static void
+shm_lock()
+{
+#ifdef HAVE_PTHREAD_MUTEX_CONSISTENT
+	if (pthread_mutex_lock(&shm->lock) == EOWNERDEAD)
+		pthread_mutex_consistent(&shm->lock);
+#else
+	pthread_mutex_lock(&shm->lock);
+#endif
+}
+/* }}} */
+/* {{{ shm_find_slot(const char *key, int key_len, ulong h)
+   Find the slot holding the given key, or the empty slot where it belongs.
+   Returns NULL if the table is full.  The lock must be held. */
+static python_shm_slot *
+shm_find_slot(const char *key, int key_len, ulong h)
+{
+	ulong i, n;
+
+	for (n = 0, i = h & (shm->nslots - 1); n < shm->nslots;
+		 ++n, i = (i + 1) & (shm->nslots - 1)) {
+		python_shm_slot *slot = &shm->slots[i];
+
+		if (slot->data_len == 0)
+			return slot;
+
+		if (slot->h == h && slot->key_len == (size_t)key_len &&
+			memcmp((char *)shm + slot->key_offset, key, key_len) == 0)
+			return slot;
+	}
+
+	return NULL;
+}
+/* }}} */
+
+/* {{{ python_shm_init(size_t size)
+   Create the shared code cache segment.  A size of zero disables it. */
+int
+python_shm_init(size_t size)
+{
+	pthread_mutexattr_t attr;
+	ulong nslots;
+	size_t header_size;
+	void *segment;
+
+	if (size == 0)
+		return SUCCESS;
+
+	/*
+	 * Reserve roughly an eighth of the segment for the slot table.  The
+	 * number of slots is rounded down to a power of two so that probing
+	 * can use a simple mask.
+	 */
+	for (nslots = 1; (nslots << 1) * sizeof(python_shm_slot) <= size / 8; )
+		nslots <<= 1;
+
+	header_size = sizeof(python_shm_header) +
+				  (nslots - 1) * sizeof(python_shm_slot);
+	if (header_size >= size) {
+		php_error(E_WARNING, "Python: python.shm_size is too small");
+		return FAILURE;
+	}
+
+	segment = mmap(NULL, size, PROT_READ | PROT_WRITE,
+				   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (segment == MAP_FAILED) {
+		php_error(E_WARNING, "Python: Failed to map %lu bytes of shared memory",
+				  (unsigned long)size);
+		return FAILURE;
+	}
+
+	shm = (python_shm_header *)segment;
+	memset(shm, 0, header_size);
+	shm->size = size;
+	shm->used = header_size;
+	shm->nslots = nslots;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+#ifdef HAVE_PTHREAD_MUTEX_CONSISTENT
+	pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+#endif
+	pthread_mutex_init(&shm->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	return SUCCESS;
+}
+/* }}} */
+/* {{{ python_shm_shutdown()
+   Unmap the shared code cache segment. */
+void
+python_shm_shutdown()
+{
+	if (shm) {
+		munmap((void *)shm, shm->size);
+		shm = NULL;
+	}
+}
+/* }}} */
+/* {{{ python_shm_fetch(const char *key, int key_len)
+   Return a new reference to the code object stored under the given key, or
+   NULL if there isn't one.  No Python exception is left set. */
+PyObject *
+python_shm_fetch(const char *key, int key_len)
+{
+	python_shm_slot *slot;
+	size_t offset = 0, len = 0;
+	ulong h;
+	PyObject *code;
+
+	if (shm == NULL)
+		return NULL;
+
+	h = zend_get_hash_value((char *)key, key_len);
+
+	shm_lock();
+	slot = shm_find_slot(key, key_len, h);
+	if (slot && slot->data_len) {
+		offset = slot->data_offset;
+		len = slot->data_len;
+	}
+	pthread_mutex_unlock(&shm->lock);
+
+	if (len == 0)
+		return NULL;
+
+	/* Published data never changes, so we can read it without the lock. */
+	code = PyMarshal_ReadObjectFromString((char *)shm + offset, len);
+	if (code == NULL || !PyCode_Check(code)) {
+		Py_XDECREF(code);
+		PyErr_Clear();
+		return NULL;
+	}
+
+	return code;
+}
+/* }}} */
+/* {{{ python_shm_store(const char *key, int key_len, PyObject *code)
+   Store a marshalled copy of the code object under the given key. */
+void
+python_shm_store(const char *key, int key_len, PyObject *code)
+{
+	python_shm_slot *slot;
+	PyObject *data;
+	size_t data_len, needed;
+	ulong h;
+
+	if (shm == NULL)
+		return;
+
+	data = PyMarshal_WriteObjectToString(code, Py_MARSHAL_VERSION);
+	if (data == NULL) {
+		PyErr_Clear();
+		return;
+	}
+
+	data_len = PyString_GET_SIZE(data);
+	needed = key_len + data_len;
+	h = zend_get_hash_value((char *)key, key_len);
+
+	shm_lock();
+
+	/*
+	 * Leave the last slot free so that probing for a missing key always
+	 * terminates at an empty slot.
+	 */
+	slot = shm_find_slot(key, key_len, h);
+	if (slot && slot->data_len == 0 && shm->count + 1 < shm->nslots &&
+		needed <= shm->size - shm->used) {
+		char *base = (char *)shm;
+		size_t offset = shm->used;
+
+		shm->used += needed;
+
+		memcpy(base + offset, key, key_len);
+		memcpy(base + offset + key_len, PyString_AS_STRING(data), data_len);
+
+		slot->h = h;
+		slot->key_offset = offset;
+		slot->key_len = key_len;
+		slot->data_offset = offset + key_len;
+		shm->count++;
+#ifdef __GNUC__
+		__sync_synchronize();
+#endif
+		slot->data_len = data_len;
+	}
+
+	pthread_mutex_unlock(&shm->lock);
+
+	Py_DECREF(data);
+}
+/* }}} */
+/* {{{ python_shm_info(size_t *size, size_t *used, ulong *count)
+   Report the shared code cache's statistics.  Returns FAILURE if the cache
+   is disabled. */
+int
+python_shm_info(size_t *size, size_t *used, ulong *count)
+{
+	if (shm == NULL)
+		return FAILURE;
+
+	shm_lock();
+	*size = shm->size;
+	*used = shm->used;
+	*count = shm->count;
+	pthread_mutex_unlock(&shm->lock);
+
+	return SUCCESS;
+}
+/* }}} */
+
+#else
+
+/*
+ * Shared memory segments that survive a fork() aren't available on Windows,
+ * where each PHP process is started from scratch.  The shared code cache is
+ * simply disabled there.
+ */
+
+int python_shm_init(size_t size) { return SUCCESS; }
+void python_shm_shutdown() { }
+PyObject * python_shm_fetch(const char *key, int key_len) { return NULL; }
+void python_shm_store(const char *key, int key_len, PyObject *code) { }
+int python_shm_info(size_t *size, size_t *used, ulong *count) { return FAILURE; }
+
+#endif
+
+/*
+ * Local variables:
+ * c-basic-offset: 4
+ * tab-width: 4
+ * End:
+ * vim600: fdm=marker
+ * vim: sw=4 ts=4 noet
+ */
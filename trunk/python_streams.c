@@ -25,16 +25,124 @@
  */
 
 #include "php.h"
+#include "php_ini.h"
+#include "SAPI.h"
 #include "php_python_internal.h"
 
+#include <fcntl.h>
+#ifdef PHP_WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+ZEND_EXTERN_MODULE_GLOBALS(python);
+
 /* {{{ OutputStream
  */
 typedef struct {
 	PyObject_HEAD
+	char *		buffer;
+	size_t		len;
+	size_t		size;
+	size_t		threshold;
+	int			capture;
 } OutputStream;
 
 static PyTypeObject OutputStream_Type;
 
+/*
+ * Output is collected in the stream's buffer and passed on to PHP's output
+ * layer in large chunks: when the buffer reaches python.output_buffer_size
+ * bytes, when Python code flushes the stream, whenever control returns to
+ * PHP, and at the end of the request.  Only the request's own thread may
+ * write to PHP, so output from other Python threads stays buffered until
+ * the request's thread flushes it.
+ *
+ * While python_capture() is running, nothing is passed on to PHP; the
+ * buffer simply grows, and its new contents become the captured string.
+ */
+
+/* {{{ OutputStream_on_request_thread
+ */
+static int
+OutputStream_on_request_thread(TSRMLS_D)
+{
+	return PyThreadState_GET() == PYG(tstate);
+}
+/* }}} */
+/* {{{ OutputStream_drain
+   Pass the buffered output on to PHP. */
+static void
+OutputStream_drain(OutputStream *self TSRMLS_DC)
+{
+	if (self->len && !self->capture) {
+		ZEND_WRITE(self->buffer, self->len);
+		self->len = 0;
+	}
+}
+/* }}} */
+/* {{{ OutputStream_append
+ */
+static int
+OutputStream_append(OutputStream *self, const char *str, size_t len TSRMLS_DC)
+{
+	int on_thread = OutputStream_on_request_thread(TSRMLS_C);
+
+	/* Large writes (or any write, when unbuffered) go straight through. */
+	if (on_thread && !self->capture && self->len + len >= self->threshold) {
+		OutputStream_drain(self TSRMLS_CC);
+		if (len >= self->threshold) {
+			ZEND_WRITE(str, len);
+			return 0;
+		}
+	}
+
+	if (self->len + len > self->size) {
+		size_t size = self->size ? self->size : 1024;
+		char *buffer;
+
+		while (size < self->len + len)
+			size *= 2;
+
+		buffer = PyMem_Realloc(self->buffer, size);
+		if (buffer == NULL) {
+			PyErr_NoMemory();
+			return -1;
+		}
+
+		self->buffer = buffer;
+		self->size = size;
+	}
+
+	memcpy(self->buffer + self->len, str, len);
+	self->len += len;
+
+	return 0;
+}
+/* }}} */
+/* {{{ OutputStream_flush_request(TSRMLS_D)
+   Pass the request's buffered sys.stdout output on to PHP, if this is the
+   request's thread. */
+static void
+OutputStream_flush_request(TSRMLS_D)
+{
+	OutputStream *output = (OutputStream *)PYG(output);
+
+	if (output && output->len && OutputStream_on_request_thread(TSRMLS_C))
+		OutputStream_drain(output TSRMLS_CC);
+}
+/* }}} */
+/* {{{ OutputStream_dealloc
+ */
+static void
+OutputStream_dealloc(OutputStream *self)
+{
+	PyMem_Free(self->buffer);
+	PyObject_Del(self);
+}
+/* }}} */
+
 /* {{{ OutputStream_close
  */
 static PyObject *
@@ -52,9 +160,14 @@ OutputStream_close(OutputStream *self, PyObject *args)
 static PyObject *
 OutputStream_flush(OutputStream *self, PyObject *args)
 {
+	TSRMLS_FETCH();
+
 	if (!PyArg_ParseTuple(args, ":flush"))
 		return NULL;
 
+	if (OutputStream_on_request_thread(TSRMLS_C))
+		OutputStream_drain(self TSRMLS_CC);
+
 	Py_INCREF(Py_None);
 	return Py_None;
 }
@@ -67,10 +180,13 @@ OutputStream_write(OutputStream *self, PyObject *args)
 	const char *str;
 	int len;
 
+	TSRMLS_FETCH();
+
 	if (!PyArg_ParseTuple(args, "s#:write", &str, &len))
 		return NULL;
 
-	ZEND_WRITE(str, len);
+	if (OutputStream_append(self, str, len TSRMLS_CC) < 0)
+		return NULL;
 
 	Py_INCREF(Py_None);
 	return Py_None;
@@ -85,7 +201,9 @@ OutputStream_writelines(OutputStream *self, PyObject *args)
 	PyObject *iterator;
 	PyObject *item;
 	char *str;
-	int len;
+	Py_ssize_t len;
+
+	TSRMLS_FETCH();
 
 	if (!PyArg_ParseTuple(args, "O:writelines", &sequence))
         return NULL;
@@ -95,10 +213,11 @@ OutputStream_writelines(OutputStream *self, PyObject *args)
 		return NULL;
 
 	while (item = PyIter_Next(iterator)) {
-		if (PyString_AsStringAndSize(item, &str, &len) != -1) {
-			ZEND_WRITE(str, len);
+		if (PyString_AsStringAndSize(item, &str, &len) != -1 &&
+			OutputStream_append(self, str, len TSRMLS_CC) == 0) {
 			Py_DECREF(item);
 		} else {
+			str = NULL;
 			Py_DECREF(item);
 			break;
 		}
@@ -106,7 +225,7 @@ OutputStream_writelines(OutputStream *self, PyObject *args)
 
 	Py_DECREF(iterator);
 
-	if (item && !str)
+	if (item || PyErr_Occurred())
 		return NULL;
 
 	Py_INCREF(Py_None);
@@ -159,7 +278,7 @@ static PyTypeObject OutputStream_Type = {
 	"php.OutputStream",									/* tp_name */
 	sizeof(OutputStream),								/* tp_basicsize */
 	0,													/* tp_itemsize */
-	0,													/* tp_dealloc */
+	(destructor)OutputStream_dealloc,					/* tp_dealloc */
 	0,													/* tp_print */
 	0,													/* tp_getattr */
 	0,													/* tp_setattr */
@@ -192,10 +311,208 @@ static PyTypeObject OutputStream_Type = {
  */
 typedef struct {
 	PyObject_HEAD
+	char *		line;			/* incomplete line */
+	size_t		line_len;
+	size_t		line_size;
+	char *		entry;			/* pending log entry */
+	size_t		entry_len;
+	size_t		entry_size;
+	int			traceback;		/* the pending entry is a traceback */
+	int			sink;
+	int			level;
 } ErrorStream;
 
 static PyTypeObject ErrorStream_Type;
 
+/*
+ * Error output is collected line by line and grouped into log entries: a
+ * line plus any indented lines that follow it.  A traceback also takes in
+ * the exception line that ends it, so it becomes one entry.  An entry is
+ * sent to the configured sink once the next entry starts, or when the
+ * stream is flushed (which happens whenever control returns to PHP).
+ */
+
+#define PHP_PYTHON_STDERR_ERROR	0
+#define PHP_PYTHON_STDERR_LOG	1
+#define PHP_PYTHON_STDERR_FILE	2
+
+static int stderr_fd = -1;
+
+/* {{{ ErrorStream_grow
+ */
+static int
+ErrorStream_grow(char **buffer, size_t *size, size_t needed)
+{
+	size_t new_size = *size ? *size : 256;
+	char *new_buffer;
+
+	if (needed <= *size)
+		return 0;
+
+	while (new_size < needed)
+		new_size *= 2;
+
+	new_buffer = PyMem_Realloc(*buffer, new_size);
+	if (new_buffer == NULL) {
+		PyErr_NoMemory();
+		return -1;
+	}
+
+	*buffer = new_buffer;
+	*size = new_size;
+
+	return 0;
+}
+/* }}} */
+/* {{{ ErrorStream_emit
+   Send the pending entry to the configured sink. */
+static void
+ErrorStream_emit(ErrorStream *self TSRMLS_DC)
+{
+	char *entry = self->entry;
+	size_t len = self->entry_len, size = self->entry_size;
+
+	if (len == 0)
+		return;
+
+	/*
+	 * Detach the entry before sending it.  A PHP error handler may run
+	 * Python code that writes to (and flushes) this stream again.
+	 */
+	self->entry = NULL;
+	self->entry_len = self->entry_size = 0;
+	self->traceback = 0;
+
+	/* The entry buffer always has room for a terminator. */
+	entry[len] = '\0';
+
+	switch (self->sink) {
+		case PHP_PYTHON_STDERR_LOG:
+			php_log_err(entry TSRMLS_CC);
+			break;
+
+		case PHP_PYTHON_STDERR_FILE:
+			if (stderr_fd >= 0) {
+				entry[len] = '\n';
+				if (write(stderr_fd, entry, len + 1) < 0)
+					break;
+			}
+			break;
+
+		default:
+			/* Keep the error in order with the output that preceded it. */
+			OutputStream_flush_request(TSRMLS_C);
+			php_error(self->level, "%s", entry);
+			break;
+	}
+
+	/* Reuse the buffer unless a new one was started in the meantime. */
+	if (self->entry == NULL) {
+		self->entry = entry;
+		self->entry_size = size;
+	} else
+		PyMem_Free(entry);
+}
+/* }}} */
+/* {{{ ErrorStream_add_line
+   Add a complete line to the pending entry, or start a new entry with it. */
+static int
+ErrorStream_add_line(ErrorStream *self, const char *line, size_t len,
+					 int on_thread TSRMLS_DC)
+{
+	static const char header[] = "Traceback (most recent call last):";
+	int indented = (len > 0 && (line[0] == ' ' || line[0] == '\t'));
+	int continues = self->entry_len && (indented || self->traceback);
+
+	if (!continues && self->entry_len) {
+		/* Off the request's thread, entries just accumulate. */
+		if (on_thread)
+			ErrorStream_emit(self TSRMLS_CC);
+		else
+			self->traceback = 0;
+	}
+
+	if (ErrorStream_grow(&self->entry, &self->entry_size,
+						 self->entry_len + len + 2) < 0)
+		return -1;
+
+	if (self->entry_len)
+		self->entry[self->entry_len++] = '\n';
+	memcpy(self->entry + self->entry_len, line, len);
+	self->entry_len += len;
+
+	if (!continues)
+		self->traceback = (len >= sizeof(header) - 1 &&
+						   memcmp(line, header, sizeof(header) - 1) == 0);
+	else if (self->traceback && !indented && on_thread)
+		ErrorStream_emit(self TSRMLS_CC);
+
+	return 0;
+}
+/* }}} */
+/* {{{ ErrorStream_append
+ */
+static int
+ErrorStream_append(ErrorStream *self, const char *str, size_t len TSRMLS_DC)
+{
+	int on_thread = OutputStream_on_request_thread(TSRMLS_C);
+	const char *end = str + len, *nl;
+
+	while (str < end && (nl = memchr(str, '\n', end - str)) != NULL) {
+		if (self->line_len) {
+			if (ErrorStream_grow(&self->line, &self->line_size,
+								 self->line_len + (nl - str)) < 0)
+				return -1;
+			memcpy(self->line + self->line_len, str, nl - str);
+			self->line_len += nl - str;
+
+			if (ErrorStream_add_line(self, self->line, self->line_len,
+									 on_thread TSRMLS_CC) < 0)
+				return -1;
+			self->line_len = 0;
+		} else if (ErrorStream_add_line(self, str, nl - str,
+										on_thread TSRMLS_CC) < 0)
+			return -1;
+
+		str = nl + 1;
+	}
+
+	if (str < end) {
+		if (ErrorStream_grow(&self->line, &self->line_size,
+							 self->line_len + (end - str)) < 0)
+			return -1;
+		memcpy(self->line + self->line_len, str, end - str);
+		self->line_len += end - str;
+	}
+
+	return 0;
+}
+/* }}} */
+/* {{{ ErrorStream_drain
+   Send everything that has been written, including an incomplete line. */
+static void
+ErrorStream_drain(ErrorStream *self TSRMLS_DC)
+{
+	if (self->line_len) {
+		if (ErrorStream_add_line(self, self->line, self->line_len,
+								 1 TSRMLS_CC) < 0)
+			PyErr_Clear();
+		self->line_len = 0;
+	}
+
+	ErrorStream_emit(self TSRMLS_CC);
+}
+/* }}} */
+/* {{{ ErrorStream_dealloc
+ */
+static void
+ErrorStream_dealloc(ErrorStream *self)
+{
+	PyMem_Free(self->line);
+	PyMem_Free(self->entry);
+	PyObject_Del(self);
+}
+/* }}} */
 /* {{{ ErrorStream_close
  */
 static PyObject *
@@ -213,9 +530,14 @@ ErrorStream_close(ErrorStream *self, PyObject *args)
 static PyObject *
 ErrorStream_flush(ErrorStream *self, PyObject *args)
 {
+	TSRMLS_FETCH();
+
 	if (!PyArg_ParseTuple(args, ":flush"))
 		return NULL;
 
+	if (OutputStream_on_request_thread(TSRMLS_C))
+		ErrorStream_drain(self TSRMLS_CC);
+
 	Py_INCREF(Py_None);
 	return Py_None;
 }
@@ -226,11 +548,15 @@ static PyObject *
 ErrorStream_write(ErrorStream *self, PyObject *args)
 {
 	const char *str;
+	int len;
+
+	TSRMLS_FETCH();
 
-	if (!PyArg_ParseTuple(args, "s:write", &str))
+	if (!PyArg_ParseTuple(args, "s#:write", &str, &len))
 		return NULL;
 
-	php_error(E_NOTICE, "%s", str);
+	if (ErrorStream_append(self, str, len TSRMLS_CC) < 0)
+		return NULL;
 
 	Py_INCREF(Py_None);
 	return Py_None;
@@ -244,7 +570,10 @@ ErrorStream_writelines(ErrorStream *self, PyObject *args)
 	PyObject *sequence;
 	PyObject *iterator;
 	PyObject *item;
-	const char *str;
+	char *str;
+	Py_ssize_t len;
+
+	TSRMLS_FETCH();
 
 	if (!PyArg_ParseTuple(args, "O:writelines", &sequence))
         return NULL;
@@ -254,8 +583,8 @@ ErrorStream_writelines(ErrorStream *self, PyObject *args)
 		return NULL;
 
 	while (item = PyIter_Next(iterator)) {
-		if (str = PyString_AsString(item)) {
-			php_error(E_NOTICE, "%s", str);
+		if (PyString_AsStringAndSize(item, &str, &len) != -1 &&
+			ErrorStream_append(self, str, len TSRMLS_CC) == 0) {
 			Py_DECREF(item);
 		} else {
 			Py_DECREF(item);
@@ -265,7 +594,7 @@ ErrorStream_writelines(ErrorStream *self, PyObject *args)
 
 	Py_DECREF(iterator);
 
-	if (item && !str)
+	if (item || PyErr_Occurred())
 		return NULL;
 
 	Py_INCREF(Py_None);
@@ -273,7 +602,7 @@ ErrorStream_writelines(ErrorStream *self, PyObject *args)
 }
 /* }}} */
 
-/* {{{ ErrorStream_close
+/* {{{ ErrorStream_closed
  */
 static PyObject *
 ErrorStream_closed(ErrorStream *self, void *closure)
@@ -318,7 +647,7 @@ static PyTypeObject ErrorStream_Type = {
 	"php.ErrorStream",									/* tp_name */
 	sizeof(ErrorStream),								/* tp_basicsize */
 	0,													/* tp_itemsize */
-	0,													/* tp_dealloc */
+	(destructor)ErrorStream_dealloc,					/* tp_dealloc */
 	0,													/* tp_print */
 	0,													/* tp_getattr */
 	0,													/* tp_setattr */
@@ -348,38 +677,995 @@ static PyTypeObject ErrorStream_Type = {
 /* }}} */
 /* }}} */
 
-/* {{{ int python_streams_init()
-   Initialize the Python streams interface. */
-int
-python_streams_init()
+/* {{{ Stream
+ */
+typedef struct {
+	PyObject_HEAD
+	int			rsrc_id;
+} Stream;
+
+static PyTypeObject Stream_Type;
+
+/*
+ * A Stream wraps a PHP stream resource.  It holds its own reference to the
+ * resource (rather than a php_stream pointer) and looks the stream up again
+ * for each operation, so a stream that PHP has already freed is reported as
+ * closed instead of being used.  Closing a Stream releases that reference;
+ * the stream itself is closed once PHP no longer refers to it either.
+ *
+ * PHP streams belong to the request, so they can only be used from the
+ * request's own thread.  The thread state is given up for the duration of
+ * each I/O call, which also lets user-space stream wrappers call back into
+ * Python.
+ */
+
+/* {{{ Stream_wrap
+   Wrap the given stream resource.  The new object takes over one reference
+   to the resource. */
+static PyObject *
+Stream_wrap(int rsrc_id)
 {
-	if (PyType_Ready(&OutputStream_Type) == -1)
-		return FAILURE;
+	Stream *self;
 
-	if (PyType_Ready(&ErrorStream_Type) == -1)
-		return FAILURE;
+	self = PyObject_New(Stream, &Stream_Type);
+	if (self == NULL)
+		return NULL;
 
-	return SUCCESS;
+	self->rsrc_id = rsrc_id;
+
+	return (PyObject *)self;
 }
 /* }}} */
-/* {{{ int python_streams_intercept()
-   Redirect Python's streams to PHP equivalents. */
-int
-python_streams_intercept()
+/* {{{ Stream_lookup
+   Find the php_stream registered as the given resource, if there is one. */
+static php_stream *
+Stream_lookup(int rsrc_id TSRMLS_DC)
 {
-	PyObject *stream;
+	void *ptr;
+	int type;
 
-	/* Redirect sys.stdout to an instance of our output stream type. */
-	stream = (PyObject *)PyObject_New(OutputStream, &OutputStream_Type);
-	PySys_SetObject("stdout", stream);
-	Py_DECREF(stream);
+	if (rsrc_id == 0 || (ptr = zend_list_find(rsrc_id, &type)) == NULL)
+		return NULL;
 
-	/* Redirect sys.stderr to an instance of our error stream type. */
-	stream = (PyObject *)PyObject_New(ErrorStream, &ErrorStream_Type);
-	PySys_SetObject("stderr", stream);
-	Py_DECREF(stream);
+	if (type != php_file_le_stream() && type != php_file_le_pstream())
+		return NULL;
 
-	return SUCCESS;
+	return (php_stream *)ptr;
+}
+/* }}} */
+/* {{{ Stream_fetch
+   Look up the wrapped php_stream, raising an exception if it can't be used. */
+static php_stream *
+Stream_fetch(Stream *self TSRMLS_DC)
+{
+	php_stream *stream;
+
+	if (!OutputStream_on_request_thread(TSRMLS_C)) {
+		PyErr_SetString(PyExc_RuntimeError,
+						"PHP streams cannot be used from this thread");
+		return NULL;
+	}
+
+	stream = Stream_lookup(self->rsrc_id TSRMLS_CC);
+	if (stream == NULL) {
+		PyErr_SetString(PyExc_ValueError, "I/O operation on closed stream");
+		return NULL;
+	}
+
+	return stream;
+}
+/* }}} */
+/* {{{ Stream_release
+ */
+static void
+Stream_release(Stream *self TSRMLS_DC)
+{
+	if (self->rsrc_id) {
+		zend_list_delete(self->rsrc_id);
+		self->rsrc_id = 0;
+	}
+}
+/* }}} */
+/* {{{ Stream_open
+   Open a new stream using PHP's stream wrappers. */
+static PyObject *
+Stream_open(char *path, char *mode TSRMLS_DC)
+{
+	php_stream *stream;
+	int depth;
+
+	if (!OutputStream_on_request_thread(TSRMLS_C)) {
+		PyErr_SetString(PyExc_RuntimeError,
+						"PHP streams cannot be used from this thread");
+		return NULL;
+	}
+
+	PHP_PYTHON_THREAD_SUSPEND(depth);
+	stream = php_stream_open_wrapper(path, mode, REPORT_ERRORS, NULL);
+	PHP_PYTHON_THREAD_RESUME(depth);
+
+	if (stream == NULL) {
+		PyErr_Format(PyExc_IOError, "Failed to open stream: %s", path);
+		return NULL;
+	}
+
+	return Stream_wrap(stream->rsrc_id);
+}
+/* }}} */
+/* {{{ Stream_new
+   php.Stream(path[, mode]) opens a new stream using PHP's stream wrappers. */
+static PyObject *
+Stream_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+	static char *kwlist[] = { "path", "mode", NULL };
+	char *path, *mode = "rb";
+	TSRMLS_FETCH();
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|s:Stream", kwlist,
+									 &path, &mode))
+		return NULL;
+
+	return Stream_open(path, mode TSRMLS_CC);
+}
+/* }}} */
+/* {{{ Stream_dealloc
+ */
+static void
+Stream_dealloc(Stream *self)
+{
+	TSRMLS_FETCH();
+
+	/*
+	 * The resource list can only be modified from the request's thread.
+	 * Anywhere else, the reference is left for the end of the request.
+	 */
+	if (OutputStream_on_request_thread(TSRMLS_C))
+		Stream_release(self TSRMLS_CC);
+
+	PyObject_Del(self);
+}
+/* }}} */
+/* {{{ Stream_read
+ */
+static PyObject *
+Stream_read(Stream *self, PyObject *args)
+{
+	php_stream *stream;
+	PyObject *result;
+	long size = -1;
+	size_t len = 0, n;
+	int depth;
+	TSRMLS_FETCH();
+
+	if (!PyArg_ParseTuple(args, "|l:read", &size))
+		return NULL;
+
+	if ((stream = Stream_fetch(self TSRMLS_CC)) == NULL)
+		return NULL;
+
+	if (size < 0) {
+		char *buf = NULL;
+
+		PHP_PYTHON_THREAD_SUSPEND(depth);
+		len = php_stream_copy_to_mem(stream, &buf, PHP_STREAM_COPY_ALL, 0);
+		PHP_PYTHON_THREAD_RESUME(depth);
+
+		result = PyString_FromStringAndSize(buf, buf ? len : 0);
+		if (buf)
+			efree(buf);
+
+		return result;
+	}
+
+	/* Read straight into the string object's storage. */
+	result = PyString_FromStringAndSize(NULL, size);
+	if (result == NULL)
+		return NULL;
+
+	PHP_PYTHON_THREAD_SUSPEND(depth);
+	while (len < (size_t)size) {
+		n = php_stream_read(stream, PyString_AS_STRING(result) + len,
+							size - len);
+		if (n == 0)
+			break;
+		len += n;
+	}
+	PHP_PYTHON_THREAD_RESUME(depth);
+
+	if (len != (size_t)size && _PyString_Resize(&result, len) == -1)
+		return NULL;
+
+	return result;
+}
+/* }}} */
+/* {{{ Stream_readinto
+ */
+static PyObject *
+Stream_readinto(Stream *self, PyObject *args)
+{
+	php_stream *stream;
+	Py_buffer buffer;
+	size_t len;
+	int depth;
+	TSRMLS_FETCH();
+
+	if (!PyArg_ParseTuple(args, "w*:readinto", &buffer))
+		return NULL;
+
+	if ((stream = Stream_fetch(self TSRMLS_CC)) == NULL) {
+		PyBuffer_Release(&buffer);
+		return NULL;
+	}
+
+	PHP_PYTHON_THREAD_SUSPEND(depth);
+	len = php_stream_read(stream, buffer.buf, buffer.len);
+	PHP_PYTHON_THREAD_RESUME(depth);
+
+	PyBuffer_Release(&buffer);
+
+	return PyInt_FromSize_t(len);
+}
+/* }}} */
+/* {{{ Stream_readline
+ */
+static PyObject *
+Stream_readline(Stream *self, PyObject *args)
+{
+	php_stream *stream;
+	PyObject *result;
+	long size = -1;
+	size_t len = 0;
+	char *buf, *line;
+	int depth;
+	TSRMLS_FETCH();
+
+	if (!PyArg_ParseTuple(args, "|l:readline", &size))
+		return NULL;
+
+	if ((stream = Stream_fetch(self TSRMLS_CC)) == NULL)
+		return NULL;
+
+	if (size == 0)
+		return PyString_FromStringAndSize(NULL, 0);
+
+	/*
+	 * Without a buffer, php_stream_get_line() allocates one as large as the
+	 * line.  A size limit needs a buffer of that size (plus the NUL).
+	 */
+	buf = (size > 0) ? emalloc(size + 1) : NULL;
+
+	PHP_PYTHON_THREAD_SUSPEND(depth);
+	line = php_stream_get_line(stream, buf, (size > 0) ? size + 1 : 0, &len);
+	PHP_PYTHON_THREAD_RESUME(depth);
+
+	result = PyString_FromStringAndSize(line, line ? len : 0);
+	if (buf)
+		efree(buf);
+	else if (line)
+		efree(line);
+
+	return result;
+}
+/* }}} */
+/* {{{ Stream_write
+ */
+static PyObject *
+Stream_write(Stream *self, PyObject *args)
+{
+	php_stream *stream;
+	const char *str;
+	int len;
+	size_t written;
+	int depth;
+	TSRMLS_FETCH();
+
+	if (!PyArg_ParseTuple(args, "s#:write", &str, &len))
+		return NULL;
+
+	if ((stream = Stream_fetch(self TSRMLS_CC)) == NULL)
+		return NULL;
+
+	PHP_PYTHON_THREAD_SUSPEND(depth);
+	written = php_stream_write(stream, str, len);
+	PHP_PYTHON_THREAD_RESUME(depth);
+
+	return PyInt_FromSize_t(written);
+}
+/* }}} */
+/* {{{ Stream_seek
+ */
+static PyObject *
+Stream_seek(Stream *self, PyObject *args)
+{
+	php_stream *stream;
+	long offset;
+	int whence = SEEK_SET, status;
+	int depth;
+	TSRMLS_FETCH();
+
+	if (!PyArg_ParseTuple(args, "l|i:seek", &offset, &whence))
+		return NULL;
+
+	if ((stream = Stream_fetch(self TSRMLS_CC)) == NULL)
+		return NULL;
+
+	PHP_PYTHON_THREAD_SUSPEND(depth);
+	status = php_stream_seek(stream, offset, whence);
+	PHP_PYTHON_THREAD_RESUME(depth);
+
+	if (status != 0) {
+		PyErr_SetString(PyExc_IOError, "Stream does not support seeking");
+		return NULL;
+	}
+
+	return PyLong_FromLong(php_stream_tell(stream));
+}
+/* }}} */
+/* {{{ Stream_tell
+ */
+static PyObject *
+Stream_tell(Stream *self, PyObject *args)
+{
+	php_stream *stream;
+	TSRMLS_FETCH();
+
+	if ((stream = Stream_fetch(self TSRMLS_CC)) == NULL)
+		return NULL;
+
+	return PyLong_FromLong(php_stream_tell(stream));
+}
+/* }}} */
+/* {{{ Stream_flush
+ */
+static PyObject *
+Stream_flush(Stream *self, PyObject *args)
+{
+	php_stream *stream;
+	int depth;
+	TSRMLS_FETCH();
+
+	if ((stream = Stream_fetch(self TSRMLS_CC)) == NULL)
+		return NULL;
+
+	PHP_PYTHON_THREAD_SUSPEND(depth);
+	php_stream_flush(stream);
+	PHP_PYTHON_THREAD_RESUME(depth);
+
+	Py_RETURN_NONE;
+}
+/* }}} */
+/* {{{ Stream_close
+ */
+static PyObject *
+Stream_close(Stream *self, PyObject *args)
+{
+	TSRMLS_FETCH();
+
+	if (!OutputStream_on_request_thread(TSRMLS_C)) {
+		PyErr_SetString(PyExc_RuntimeError,
+						"PHP streams cannot be used from this thread");
+		return NULL;
+	}
+
+	Stream_release(self TSRMLS_CC);
+
+	Py_RETURN_NONE;
+}
+/* }}} */
+/* {{{ Stream_enter
+ */
+static PyObject *
+Stream_enter(Stream *self, PyObject *args)
+{
+	Py_INCREF(self);
+	return (PyObject *)self;
+}
+/* }}} */
+/* {{{ Stream_exit
+ */
+static PyObject *
+Stream_exit(Stream *self, PyObject *args)
+{
+	return Stream_close(self, NULL);
+}
+/* }}} */
+/* {{{ Stream_iternext
+ */
+static PyObject *
+Stream_iternext(Stream *self)
+{
+	PyObject *args, *line;
+
+	if ((args = PyTuple_New(0)) == NULL)
+		return NULL;
+
+	line = Stream_readline(self, args);
+	Py_DECREF(args);
+
+	/* An empty line means the end of the stream. */
+	if (line && PyString_GET_SIZE(line) == 0)
+		Py_CLEAR(line);
+
+	return line;
+}
+/* }}} */
+/* {{{ Stream_closed
+ */
+static PyObject *
+Stream_closed(Stream *self, void *closure)
+{
+	php_stream *stream = NULL;
+	TSRMLS_FETCH();
+
+	if (OutputStream_on_request_thread(TSRMLS_C))
+		stream = Stream_lookup(self->rsrc_id TSRMLS_CC);
+
+	return PyBool_FromLong(stream == NULL);
+}
+/* }}} */
+
+/* {{{ Stream_methods
+ */
+static PyMethodDef Stream_methods[] = {
+	{ "read",		(PyCFunction)Stream_read,		METH_VARARGS, 0 },
+	{ "readinto",	(PyCFunction)Stream_readinto,	METH_VARARGS, 0 },
+	{ "readline",	(PyCFunction)Stream_readline,	METH_VARARGS, 0 },
+	{ "write",		(PyCFunction)Stream_write,		METH_VARARGS, 0 },
+	{ "seek",		(PyCFunction)Stream_seek,		METH_VARARGS, 0 },
+	{ "tell",		(PyCFunction)Stream_tell,		METH_NOARGS, 0 },
+	{ "flush",		(PyCFunction)Stream_flush,		METH_NOARGS, 0 },
+	{ "close",		(PyCFunction)Stream_close,		METH_NOARGS, 0 },
+	{ "__enter__",	(PyCFunction)Stream_enter,		METH_NOARGS, 0 },
+	{ "__exit__",	(PyCFunction)Stream_exit,		METH_VARARGS, 0 },
+	{ NULL, NULL}
+};
+/* }}} */
+/* {{{ Stream_getset
+ */
+static PyGetSetDef Stream_getset[] = {
+	{ "closed",		(getter)Stream_closed,		NULL, 0 },
+	{ NULL },
+};
+/* }}} */
+/* {{{ Stream_Type
+ */
+static PyTypeObject Stream_Type = {
+	PyObject_HEAD_INIT(NULL)
+	0,													/* ob_size */
+	"php.Stream",										/* tp_name */
+	sizeof(Stream),										/* tp_basicsize */
+	0,													/* tp_itemsize */
+	(destructor)Stream_dealloc,							/* tp_dealloc */
+	0,													/* tp_print */
+	0,													/* tp_getattr */
+	0,													/* tp_setattr */
+	0,													/* tp_compare */
+	0,													/* tp_repr */
+	0,													/* tp_as_number */
+	0,													/* tp_as_sequence */
+	0,													/* tp_as_mapping */
+	0,													/* tp_hash */
+	0,													/* tp_call */
+	0,													/* tp_str */
+	0,													/* tp_getattro */
+	0,													/* tp_setattro */
+	0,													/* tp_as_buffer */
+	Py_TPFLAGS_DEFAULT,									/* tp_flags */
+	"PHP Stream",										/* tp_doc */
+	0,													/* tp_traverse */
+	0,													/* tp_clear */
+	0,													/* tp_richcompare */
+	0,													/* tp_weaklistoffset */
+	PyObject_SelfIter,									/* tp_iter */
+	(iternextfunc)Stream_iternext,						/* tp_iternext */
+	Stream_methods,										/* tp_methods */
+	0,													/* tp_members */
+	Stream_getset,										/* tp_getset */
+	0,													/* tp_base */
+	0,													/* tp_dict */
+	0,													/* tp_descr_get */
+	0,													/* tp_descr_set */
+	0,													/* tp_dictoffset */
+	0,													/* tp_init */
+	0,													/* tp_alloc */
+	Stream_new,											/* tp_new */
+};
+/* }}} */
+/* }}} */
+
+/* {{{ InputStream
+ */
+typedef struct {
+	PyObject_HEAD
+	Stream *	stream;
+	int			closed;
+} InputStream;
+
+static PyTypeObject InputStream_Type;
+
+/*
+ * sys.stdin reads the request body through php://input, which pulls it from
+ * the SAPI's POST reader in chunks as it is consumed.  The php://input
+ * stream is only opened on first use, so requests that never read from
+ * sys.stdin don't pay for it.  The reading itself is done by the Stream
+ * methods above.
+ */
+
+/* {{{ InputStream_stream
+   Return the underlying php://input stream, opening it if necessary. */
+static Stream *
+InputStream_stream(InputStream *self TSRMLS_DC)
+{
+	if (self->closed) {
+		PyErr_SetString(PyExc_ValueError, "I/O operation on closed stream");
+		return NULL;
+	}
+
+	if (self->stream == NULL)
+		self->stream = (Stream *)Stream_open("php://input", "rb" TSRMLS_CC);
+
+	return self->stream;
+}
+/* }}} */
+/* {{{ InputStream_dealloc
+ */
+static void
+InputStream_dealloc(InputStream *self)
+{
+	Py_XDECREF(self->stream);
+	PyObject_Del(self);
+}
+/* }}} */
+/* {{{ InputStream_read
+ */
+static PyObject *
+InputStream_read(InputStream *self, PyObject *args)
+{
+	Stream *stream;
+	TSRMLS_FETCH();
+
+	if ((stream = InputStream_stream(self TSRMLS_CC)) == NULL)
+		return NULL;
+
+	return Stream_read(stream, args);
+}
+/* }}} */
+/* {{{ InputStream_readinto
+ */
+static PyObject *
+InputStream_readinto(InputStream *self, PyObject *args)
+{
+	Stream *stream;
+	TSRMLS_FETCH();
+
+	if ((stream = InputStream_stream(self TSRMLS_CC)) == NULL)
+		return NULL;
+
+	return Stream_readinto(stream, args);
+}
+/* }}} */
+/* {{{ InputStream_readline
+ */
+static PyObject *
+InputStream_readline(InputStream *self, PyObject *args)
+{
+	Stream *stream;
+	TSRMLS_FETCH();
+
+	if ((stream = InputStream_stream(self TSRMLS_CC)) == NULL)
+		return NULL;
+
+	return Stream_readline(stream, args);
+}
+/* }}} */
+/* {{{ InputStream_readlines
+ */
+static PyObject *
+InputStream_readlines(InputStream *self, PyObject *args)
+{
+	Stream *stream;
+	TSRMLS_FETCH();
+
+	if ((stream = InputStream_stream(self TSRMLS_CC)) == NULL)
+		return NULL;
+
+	return PySequence_List((PyObject *)stream);
+}
+/* }}} */
+/* {{{ InputStream_iternext
+ */
+static PyObject *
+InputStream_iternext(InputStream *self)
+{
+	Stream *stream;
+	TSRMLS_FETCH();
+
+	if ((stream = InputStream_stream(self TSRMLS_CC)) == NULL)
+		return NULL;
+
+	return Stream_iternext(stream);
+}
+/* }}} */
+/* {{{ InputStream_close
+ */
+static PyObject *
+InputStream_close(InputStream *self, PyObject *args)
+{
+	self->closed = 1;
+	Py_CLEAR(self->stream);
+
+	Py_RETURN_NONE;
+}
+/* }}} */
+/* {{{ InputStream_closed
+ */
+static PyObject *
+InputStream_closed(InputStream *self, void *closure)
+{
+	return PyBool_FromLong(self->closed);
+}
+/* }}} */
+/* {{{ InputStream_isatty
+ */
+static PyObject *
+InputStream_isatty(InputStream *self)
+{
+	Py_INCREF(Py_False);
+	return Py_False;
+}
+/* }}} */
+
+/* {{{ InputStream_methods
+ */
+static PyMethodDef InputStream_methods[] = {
+	{ "read",		(PyCFunction)InputStream_read,		METH_VARARGS, 0 },
+	{ "readinto",	(PyCFunction)InputStream_readinto,	METH_VARARGS, 0 },
+	{ "readline",	(PyCFunction)InputStream_readline,	METH_VARARGS, 0 },
+	{ "readlines",	(PyCFunction)InputStream_readlines,	METH_VARARGS, 0 },
+	{ "close",		(PyCFunction)InputStream_close,		METH_VARARGS, 0 },
+	{ "isatty",		(PyCFunction)InputStream_isatty,	METH_NOARGS, 0 },
+	{ NULL, NULL}
+};
+/* }}} */
+/* {{{ InputStream_getset
+ */
+static PyGetSetDef InputStream_getset[] = {
+	{ "closed",		(getter)InputStream_closed,		NULL, 0 },
+	{ NULL },
+};
+/* }}} */
+/* {{{ InputStream_Type
+ */
+static PyTypeObject InputStream_Type = {
+	PyObject_HEAD_INIT(NULL)
+	0,													/* ob_size */
+	"php.InputStream",									/* tp_name */
+	sizeof(InputStream),								/* tp_basicsize */
+	0,													/* tp_itemsize */
+	(destructor)InputStream_dealloc,					/* tp_dealloc */
+	0,													/* tp_print */
+	0,													/* tp_getattr */
+	0,													/* tp_setattr */
+	0,													/* tp_compare */
+	0,													/* tp_repr */
+	0,													/* tp_as_number */
+	0,													/* tp_as_sequence */
+	0,													/* tp_as_mapping */
+	0,													/* tp_hash */
+	0,													/* tp_call */
+	0,													/* tp_str */
+	0,													/* tp_getattro */
+	0,													/* tp_setattro */
+	0,													/* tp_as_buffer */
+	Py_TPFLAGS_DEFAULT,									/* tp_flags */
+	"PHP InputStream",									/* tp_doc */
+	0,													/* tp_traverse */
+	0,													/* tp_clear */
+	0,													/* tp_richcompare */
+	0,													/* tp_weaklistoffset */
+	PyObject_SelfIter,									/* tp_iter */
+	(iternextfunc)InputStream_iternext,					/* tp_iternext */
+	InputStream_methods,								/* tp_methods */
+	0,													/* tp_members */
+	InputStream_getset,									/* tp_getset */
+};
+/* }}} */
+/* }}} */
+
+/* {{{ int python_streams_init()
+   Initialize the Python streams interface. */
+int
+python_streams_init()
+{
+	char *filename;
+
+	if (PyType_Ready(&OutputStream_Type) == -1)
+		return FAILURE;
+
+	if (PyType_Ready(&ErrorStream_Type) == -1)
+		return FAILURE;
+
+	if (PyType_Ready(&Stream_Type) == -1)
+		return FAILURE;
+
+	if (PyType_Ready(&InputStream_Type) == -1)
+		return FAILURE;
+
+	/*
+	 * The stderr log file is opened once, at startup, and shared by every
+	 * request.  Entries are written with single write() calls in append
+	 * mode, so concurrent processes don't interleave their entries.
+	 */
+	filename = INI_STR("python.stderr_file");
+	if (filename && *filename) {
+		stderr_fd = open(filename, O_WRONLY | O_APPEND | O_CREAT, 0644);
+		if (stderr_fd < 0)
+			php_error(E_WARNING, "Python: Failed to open '%s'", filename);
+	}
+
+	return SUCCESS;
+}
+/* }}} */
+/* {{{ int python_streams_register(PyObject *module)
+   Add the stream types to the given (php) module. */
+int
+python_streams_register(PyObject *module)
+{
+	Py_INCREF(&Stream_Type);
+	if (PyModule_AddObject(module, "Stream", (PyObject *)&Stream_Type) == -1)
+		return FAILURE;
+
+	return SUCCESS;
+}
+/* }}} */
+/* {{{ PyObject *python_stream_from_zval(zval *zv TSRMLS_DC)
+   Wrap the PHP stream resource held by zv in a php.Stream object.  Returns
+   NULL without setting an exception if zv isn't a stream. */
+PyObject *
+python_stream_from_zval(zval *zv TSRMLS_DC)
+{
+	PyObject *obj;
+
+	if (Stream_lookup(Z_RESVAL_P(zv) TSRMLS_CC) == NULL)
+		return NULL;
+
+	obj = Stream_wrap(Z_RESVAL_P(zv));
+	if (obj)
+		zend_list_addref(Z_RESVAL_P(zv));
+
+	return obj;
+}
+/* }}} */
+/* {{{ void python_streams_destroy()
+   Release the Python streams interface's process-wide resources. */
+void
+python_streams_destroy()
+{
+	if (stderr_fd >= 0) {
+		close(stderr_fd);
+		stderr_fd = -1;
+	}
+}
+/* }}} */
+/* {{{ stderr_level()
+   Return the error level for sys.stderr entries.  Raising an entry must not
+   end the request, so only non-fatal levels are accepted; anything else
+   falls back to E_NOTICE. */
+static int
+stderr_level(TSRMLS_D)
+{
+	long level = INI_INT("python.stderr_level");
+
+	switch (level) {
+		case E_NOTICE:
+		case E_WARNING:
+		case E_USER_NOTICE:
+		case E_USER_WARNING:
+#ifdef E_DEPRECATED
+		case E_DEPRECATED:
+		case E_USER_DEPRECATED:
+#endif
+			return (int)level;
+	}
+
+	return E_NOTICE;
+}
+/* }}} */
+/* {{{ int python_streams_intercept(TSRMLS_D)
+   Redirect Python's standard streams to PHP equivalents. */
+int
+python_streams_intercept(TSRMLS_D)
+{
+	OutputStream *output;
+	ErrorStream *errors;
+	InputStream *input;
+	char *sink;
+	long threshold;
+
+	/*
+	 * Redirect sys.stdout to an instance of our output stream type.  We keep
+	 * our own reference to it so that it can be flushed even if Python code
+	 * replaces sys.stdout.
+	 */
+	output = PyObject_New(OutputStream, &OutputStream_Type);
+	if (output == NULL)
+		return FAILURE;
+
+	threshold = INI_INT("python.output_buffer_size");
+	output->buffer = NULL;
+	output->len = output->size = 0;
+	output->threshold = (threshold > 0) ? (size_t)threshold : 0;
+	output->capture = 0;
+
+	PYG(output) = (PyObject *)output;
+	PySys_SetObject("stdout", PYG(output));
+
+	/* Redirect sys.stderr to an instance of our error stream type. */
+	errors = PyObject_New(ErrorStream, &ErrorStream_Type);
+	if (errors == NULL)
+		return FAILURE;
+
+	errors->line = errors->entry = NULL;
+	errors->line_len = errors->line_size = 0;
+	errors->entry_len = errors->entry_size = 0;
+	errors->traceback = 0;
+	errors->level = stderr_level(TSRMLS_C);
+
+	sink = INI_STR("python.stderr_sink");
+	if (sink && strcasecmp(sink, "log") == 0)
+		errors->sink = PHP_PYTHON_STDERR_LOG;
+	else if (sink && strcasecmp(sink, "file") == 0)
+		errors->sink = PHP_PYTHON_STDERR_FILE;
+	else
+		errors->sink = PHP_PYTHON_STDERR_ERROR;
+
+	PYG(errors) = (PyObject *)errors;
+	PySys_SetObject("stderr", PYG(errors));
+
+	/*
+	 * Redirect sys.stdin to the request body.  Under most SAPIs the real
+	 * stdin is either the web server's connection or nothing at all.  The
+	 * CLI has no request body, and its stdin is the user's terminal or a
+	 * pipe, so it is left alone there.
+	 */
+	if (strcmp(sapi_module.name, "cli") == 0)
+		return SUCCESS;
+
+	input = PyObject_New(InputStream, &InputStream_Type);
+	if (input == NULL)
+		return FAILURE;
+
+	input->stream = NULL;
+	input->closed = 0;
+
+	PySys_SetObject("stdin", (PyObject *)input);
+	Py_DECREF(input);
+
+	return SUCCESS;
+}
+/* }}} */
+/* {{{ void python_streams_flush(TSRMLS_D)
+   Pass any buffered sys.stdout output and sys.stderr entries on to PHP.
+   This does nothing unless it is called from the request's thread while
+   holding its thread state. */
+void
+python_streams_flush(TSRMLS_D)
+{
+	ErrorStream *errors = (ErrorStream *)PYG(errors);
+
+	OutputStream_flush_request(TSRMLS_C);
+
+	if (errors && (errors->entry_len || errors->line_len) &&
+		OutputStream_on_request_thread(TSRMLS_C))
+		ErrorStream_drain(errors TSRMLS_CC);
+}
+/* }}} */
+/* {{{ size_t python_streams_capture_start(TSRMLS_D)
+   Start capturing sys.stdout output instead of passing it on to PHP.
+   Returns a mark to pass to python_streams_capture_end().  Captures may
+   be nested. */
+size_t
+python_streams_capture_start(TSRMLS_D)
+{
+	OutputStream *output = (OutputStream *)PYG(output);
+
+	PHP_PYTHON_THREAD_ASSERT();
+
+	if (output == NULL)
+		return 0;
+
+	/* Output written before the capture started isn't part of it. */
+	OutputStream_drain(output TSRMLS_CC);
+	output->capture++;
+
+	return output->len;
+}
+/* }}} */
+/* {{{ void python_streams_capture_end(size_t mark, zval *result TSRMLS_DC)
+   Stop capturing and store the output written since the mark in result. */
+void
+python_streams_capture_end(size_t mark, zval *result TSRMLS_DC)
+{
+	OutputStream *output = (OutputStream *)PYG(output);
+
+	PHP_PYTHON_THREAD_ASSERT();
+
+	if (output == NULL) {
+		ZVAL_EMPTY_STRING(result);
+		return;
+	}
+
+	ZVAL_STRINGL(result, output->buffer + mark, output->len - mark, 1);
+
+	output->len = mark;
+	output->capture--;
+}
+/* }}} */
+/* {{{ long python_streams_output(PyObject *iterable, long flush_size TSRMLS_DC)
+   Write each string produced by the iterable straight to PHP's output,
+   flushing the SAPI after every flush_size bytes (if positive).  Returns
+   the number of bytes written, or -1 with a Python exception set. */
+long
+python_streams_output(PyObject *iterable, long flush_size TSRMLS_DC)
+{
+	PyObject *iter, *item, *str;
+	long total = 0, pending = 0;
+	int depth;
+
+	iter = PyObject_GetIter(iterable);
+	if (iter == NULL)
+		return -1;
+
+	while ((item = PyIter_Next(iter)) != NULL) {
+		if (PyUnicode_Check(item)) {
+			str = PyUnicode_AsUTF8String(item);
+			Py_DECREF(item);
+			if (str == NULL)
+				break;
+		} else if (PyString_Check(item))
+			str = item;
+		else {
+			PyErr_Format(PyExc_TypeError, "expected a string, got %.200s",
+						 Py_TYPE(item)->tp_name);
+			Py_DECREF(item);
+			break;
+		}
+
+		/*
+		 * Write the chunk without holding the thread state; the write can
+		 * block on a slow client.  Suspending also flushes anything the
+		 * generator printed to sys.stdout, so that stays in order.
+		 */
+		PHP_PYTHON_THREAD_SUSPEND(depth);
+		PHPWRITE(PyString_AS_STRING(str), PyString_GET_SIZE(str));
+		pending += PyString_GET_SIZE(str);
+		if (flush_size > 0 && pending >= flush_size) {
+			sapi_flush(TSRMLS_C);
+			pending = 0;
+		}
+		PHP_PYTHON_THREAD_RESUME(depth);
+
+		total += PyString_GET_SIZE(str);
+		Py_DECREF(str);
+
+		/* There's no point generating output nobody will receive. */
+		if (PG(connection_status) & PHP_CONNECTION_ABORTED)
+			break;
+	}
+
+	Py_DECREF(iter);
+
+	return PyErr_Occurred() ? -1 : total;
+}
+/* }}} */
+/* {{{ void python_streams_shutdown(TSRMLS_D)
+   Flush and release the request's streams. */
+void
+python_streams_shutdown(TSRMLS_D)
+{
+	python_streams_flush(TSRMLS_C);
+	Py_CLEAR(PYG(output));
+	Py_CLEAR(PYG(errors));
 }
 /* }}} */
 
@@ -0,0 +1,27 @@
+--TEST--
+Python: Convert PHP arrays to Python dictionaries
+--SKIPIF--
+<?php if (!extension_loaded('python')) die("skip\n");
+--FILE--
+<?php
+$py = <<<EOT
+def describe(rows):
+    return repr([sorted(rows[i].items()) for i in sorted(rows.keys())])
+
+def shared_keys(rows):
+    a = sorted(rows[0].keys())
+    b = sorted(rows[1].keys())
+    return a == b and len([x for x, y in zip(a, b) if x is y]) == len(a)
+EOT;
+python_exec($py);
+
+$rows = array(
+	array('id' => 'a', 'name' => 'one'),
+	array('id' => 'b', 'name' => 'two'),
+);
+
+echo python_call('__main__', 'describe', $rows), "\n";
+var_dump(python_call('__main__', 'shared_keys', $rows));
+--EXPECT--
+[[('id', 'a'), ('name', 'one')], [('id', 'b'), ('name', 'two')]]
+int(1)
@@ -0,0 +1,20 @@
+--TEST--
+Python: Convert Python Unicode strings to UTF-8 PHP strings
+--SKIPIF--
+<?php if (!extension_loaded('python')) die("skip\n");
+--FILE--
+<?php
+var_dump(python_eval('u""'));
+var_dump(python_eval('u"ascii"'));
+echo bin2hex(python_eval('u"\xe9"')), "\n";
+echo bin2hex(python_eval('u"\u20ac"')), "\n";
+echo bin2hex(python_eval('u"\U0001f600"')), "\n";
+var_dump(python_eval('u"caf\xe9 \u20ac5".encode("utf-8")') ===
+		 python_eval('u"caf\xe9 \u20ac5"'));
+--EXPECT--
+string(0) ""
+string(5) "ascii"
+c3a9
+e282ac
+f09f9880
+bool(true)
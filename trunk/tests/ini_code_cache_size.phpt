@@ -0,0 +1,42 @@
+--TEST--
+Python: INI python.code_cache_size
+--SKIPIF--
+<?php if (!extension_loaded('python')) die("skip\n");
+--INI--
+python.code_cache_size=2
+--FILE--
+<?php
+python_exec("x = 0");
+for ($i = 0; $i < 3; $i++) {
+	python_exec("x += 1");
+	echo python_eval("x"), "\n";
+}
+
+/* Cycle through more expressions than the cache can hold. */
+foreach (array('1', '2', '3', '1', '3') as $expr) {
+	echo python_eval($expr), "\n";
+}
+
+/* The same source compiled as a statement and as an expression. */
+var_dump(python_exec("x"));
+var_dump(python_eval("x"));
+
+/* Repeats of "x += 1" and "x" in the first loop, and the final "3", hit. */
+ob_start();
+phpinfo(INFO_MODULES);
+$info = ob_get_clean();
+preg_match('/^Hits => (\d+)$/m', $info, $hits);
+preg_match('/^Misses => (\d+)$/m', $info, $misses);
+echo "hits: $hits[1], misses: $misses[1]\n";
+--EXPECT--
+1
+2
+3
+1
+2
+3
+1
+3
+bool(true)
+int(3)
+hits: 5, misses: 9
@@ -0,0 +1,44 @@
+--TEST--
+Python: INI python.output_buffer_size
+--SKIPIF--
+<?php if (!extension_loaded('python')) die("skip\n");
+--INI--
+python.output_buffer_size=16
+--FILE--
+<?php
+
+function inside()
+{
+	echo "inside\n";
+}
+
+/* Output is flushed whenever control returns to PHP. */
+python_exec("import sys\nfor c in 'abc': sys.stdout.write(c)");
+echo "d\n";
+
+python_exec("import php\nprint 'before'\nphp.call('inside')\nprint 'after'");
+
+/* ... including from inside a session. */
+function session()
+{
+	python_exec("print 'x'");
+	echo "y\n";
+}
+python_session('session');
+
+/* Writes larger than the buffer go straight through. */
+python_exec("import sys\nsys.stdout.write('0123456789' * 3 + '\\n')");
+
+/* Errors stay in order with the output before them. */
+@python_exec("print 'before error'\nraise ValueError('oops')");
+echo "end\n";
+--EXPECT--
+abcd
+before
+inside
+after
+x
+y
+012345678901234567890123456789
+before error
+end
@@ -0,0 +1,33 @@
+--TEST--
+Python: INI python.shm_size with imported modules
+--SKIPIF--
+<?php if (!extension_loaded('python')) die("skip\n");
+if (substr(PHP_OS, 0, 3) == 'WIN') die("skip not available on Windows\n");
+--INI--
+python.shm_size=1M
+python.code_cache_size=0
+--FILE--
+<?php
+$dir = dirname(__FILE__) . '/ini_shm_import';
+@mkdir($dir);
+file_put_contents("$dir/shm_import_module.py", "value = 6 * 7\n");
+
+python_exec("import sys\nsys.path.insert(0, '$dir')\nimport shm_import_module");
+var_dump(python_eval("shm_import_module.value"));
+var_dump(python_eval("shm_import_module.__file__") == "$dir/shm_import_module.py");
+
+/* Three sources plus the module were published. */
+ob_start();
+phpinfo(INFO_MODULES);
+$info = ob_get_clean();
+preg_match('/^Entries => (\d+)$/m', $info, $m);
+var_dump($m[1]);
+--CLEAN--
+<?php
+$dir = dirname(__FILE__) . '/ini_shm_import';
+@unlink("$dir/shm_import_module.py");
+@rmdir($dir);
+--EXPECT--
+int(42)
+bool(true)
+string(1) "4"
@@ -0,0 +1,42 @@
+--TEST--
+Python: INI python.shm_size
+--SKIPIF--
+<?php if (!extension_loaded('python')) die("skip\n");
+if (substr(PHP_OS, 0, 3) == 'WIN') die("skip not available on Windows\n");
+--INI--
+python.shm_size=1M
+python.code_cache_size=0
+--FILE--
+<?php
+/* With the per-request cache disabled, repeats come from shared memory. */
+python_exec("x = 0");
+for ($i = 0; $i < 3; $i++) {
+	python_exec("x += 1");
+	echo python_eval("x"), "\n";
+}
+
+var_dump(python_exec("x"));
+var_dump(python_eval("x"));
+var_dump(python_eval("'%s-%d' % ('abc', 42)"));
+var_dump(python_eval("'%s-%d' % ('abc', 42)"));
+
+/* Five distinct sources were compiled, so five entries were published. */
+ob_start();
+phpinfo(INFO_MODULES);
+$info = ob_get_clean();
+preg_match('/^Entries => (\d+)$/m', $info, $m);
+var_dump($m[1]);
+
+/* The disabled per-request cache counts no misses. */
+preg_match('/^Misses => (\d+)$/m', $info, $m);
+var_dump($m[1]);
+--EXPECT--
+1
+2
+3
+bool(true)
+int(3)
+string(6) "abc-42"
+string(6) "abc-42"
+string(1) "5"
+string(1) "0"
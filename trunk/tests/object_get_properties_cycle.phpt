@@ -0,0 +1,33 @@
+--TEST--
+Python: Object (get_properties with an indirect cycle)
+--SKIPIF--
+<?php if (!extension_loaded('python')) die("skip\n");
+--FILE--
+<?php
+python_exec("
+a = []
+b = [a]
+a.append(b)
+");
+
+var_dump(python_eval('a'));
+/* Within one conversion, the same Python object is the same PHP object. */
+$a = python_eval('a');
+$outer = (array)$a;
+$inner = (array)$outer[0];
+var_dump($inner[0] === $a);
+--EXPECT--
+object(Python <type 'list'>)#1 (1) {
+  [0]=>
+  object(Python <type 'list'>)#2 (1) {
+    [0]=>
+    object(Python <type 'list'>)#1 (1) {
+      [0]=>
+      object(Python <type 'list'>)#2 (1) {
+        [0]=>
+        *RECURSION*
+      }
+    }
+  }
+}
+bool(true)
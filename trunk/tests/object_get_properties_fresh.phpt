@@ -0,0 +1,20 @@
+--TEST--
+Python: Object (get_properties after the Python object changes)
+--SKIPIF--
+<?php if (!extension_loaded('python')) die("skip\n");
+--FILE--
+<?php
+python_exec("l = []");
+
+/* Each conversion produces a new wrapper showing the current contents. */
+$a = python_eval('l');
+var_dump($a);
+python_exec('l.append(1)');
+var_dump(python_eval('l'));
+--EXPECT--
+object(Python <type 'list'>)#1 (0) {
+}
+object(Python <type 'list'>)#2 (1) {
+  [0]=>
+  int(1)
+}
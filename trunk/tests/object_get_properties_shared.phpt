@@ -0,0 +1,40 @@
+--TEST--
+Python: Object (get_properties with shared and recursive containers)
+--SKIPIF--
+<?php if (!extension_loaded('python')) die("skip\n");
+--FILE--
+<?php
+python_exec("
+inner = [1]
+shared = [inner, inner]
+
+recursive = [1]
+recursive.append(recursive)
+");
+
+var_dump(python_eval('shared'));
+var_dump(python_eval('recursive'));
+--EXPECT--
+object(Python <type 'list'>)#1 (2) {
+  [0]=>
+  object(Python <type 'list'>)#2 (1) {
+    [0]=>
+    int(1)
+  }
+  [1]=>
+  object(Python <type 'list'>)#2 (1) {
+    [0]=>
+    int(1)
+  }
+}
+object(Python <type 'list'>)#1 (2) {
+  [0]=>
+  int(1)
+  [1]=>
+  object(Python <type 'list'>)#1 (2) {
+    [0]=>
+    int(1)
+    [1]=>
+    *RECURSION*
+  }
+}
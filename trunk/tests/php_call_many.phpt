@@ -0,0 +1,45 @@
+--TEST--
+Python: php.call_many()
+--SKIPIF--
+<?php if (!extension_loaded('python')) die("skip\n");
+--FILE--
+<?php
+
+$kept = array();
+
+function keep($value)
+{
+	global $kept;
+	$kept[] = $value;
+	return count($kept);
+}
+
+$py = <<<EOT
+import php
+
+print php.call_many('strtoupper', ['a', 'b', 'c'])
+print php.call_many('str_repeat', (('x', n) for n in range(4)))
+print php.call_many(php.function('max'), [(1, 2), (5, 4, 3), (7, 9)])
+print php.call_many('keep', ['one', ('two',), [3]])
+print php.call_many('strtoupper', [])
+EOT;
+
+python_exec($py);
+var_dump($kept);
+--EXPECT--
+['A', 'B', 'C']
+['', 'x', 'xx', 'xxx']
+[2, 5, 9]
+[1, 2, 3]
+[]
+array(3) {
+  [0]=>
+  string(3) "one"
+  [1]=>
+  string(3) "two"
+  [2]=>
+  object(Python <type 'list'>)#1 (1) {
+    [0]=>
+    int(3)
+  }
+}
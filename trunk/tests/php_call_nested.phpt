@@ -0,0 +1,25 @@
+--TEST--
+Python: php.call() re-entering Python
+--SKIPIF--
+<?php if (!extension_loaded('python')) die("skip\n");
+--FILE--
+<?php
+
+function inner($s)
+{
+	/* Python is already running further up the stack. */
+	return python_eval("'$s'.upper()");
+}
+
+$py = <<<EOT
+import php
+
+print php.call('inner', ['nested'])
+EOT;
+
+python_exec($py);
+
+echo python_eval("__import__('php').call('strtolower', ['DONE'])"), "\n";
+--EXPECT--
+NESTED
+done
@@ -0,0 +1,68 @@
+--TEST--
+Python: PHP callables passed to Python
+--SKIPIF--
+<?php if (!extension_loaded('python')) die("skip\n");
+--FILE--
+<?php
+
+class Greeter
+{
+	public $greeting = 'Hello';
+
+	function greet($name)
+	{
+		return "$this->greeting, $name";
+	}
+
+	function __invoke($name)
+	{
+		return strtoupper($this->greet($name));
+	}
+}
+
+$py = <<<EOT
+def apply(f, *args):
+	return f(*args)
+
+def sort_by(items, key):
+	return sorted(items, key=key)
+
+def give_back(f):
+	return f
+EOT;
+
+python_exec($py);
+
+$g = new Greeter;
+$offset = 10;
+
+var_dump(python_call('__main__', 'apply', function ($x) use ($offset) { return $x + $offset; }, 5));
+var_dump(python_call('__main__', 'apply', array($g, 'greet'), 'world'));
+var_dump(python_call('__main__', 'apply', $g, 'world'));
+/* Python containers come back as objects; cast them to compare contents. */
+var_dump((array)python_call('__main__', 'sort_by', array(3, 1, 2), function ($x) { return -$x; }));
+
+$f = python_call('__main__', 'give_back', function () { return 'round trip'; });
+var_dump($f());
+
+/* Arrays that merely look like callables are still converted as data. */
+var_dump((array)python_call('__main__', 'give_back', array('strlen', 'x')));
+--EXPECT--
+int(15)
+string(12) "Hello, world"
+string(12) "HELLO, WORLD"
+array(3) {
+  [0]=>
+  int(3)
+  [1]=>
+  int(2)
+  [2]=>
+  int(1)
+}
+string(10) "round trip"
+array(2) {
+  [0]=>
+  string(6) "strlen"
+  [1]=>
+  string(1) "x"
+}
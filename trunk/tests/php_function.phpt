@@ -0,0 +1,46 @@
+--TEST--
+Python: php.function()
+--SKIPIF--
+<?php if (!extension_loaded('python')) die("skip\n");
+--FILE--
+<?php
+
+function join_all()
+{
+	return implode(',', func_get_args());
+}
+
+function bump(&$n)
+{
+	return ++$n;
+}
+
+$py = <<<EOT
+import php
+
+upper = php.function('strtoupper')
+print upper
+print [upper(s) for s in ('a', 'b', 'c')]
+print php.function('join_all')(*range(12))
+print php.function('strtoupper') is upper
+
+# By-reference parameters receive a copy of the Python value.
+n = 1
+print php.function('bump')(n), n
+print php.function('settype')('42', 'integer')
+
+try:
+	php.function('no_such_function')
+except NameError, e:
+	print e
+EOT;
+
+python_exec($py);
+--EXPECT--
+<php.Function strtoupper>
+['A', 'B', 'C']
+0,1,2,3,4,5,6,7,8,9,10,11
+True
+2 1
+True
+Function does not exist: no_such_function
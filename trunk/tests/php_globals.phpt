@@ -0,0 +1,67 @@
+--TEST--
+Python: php.globals and php.request
+--SKIPIF--
+<?php if (!extension_loaded('python')) die("skip\n");
+--GET--
+page=2
+--FILE--
+<?php
+
+$GLOBALS[5] = 'numbered';
+$config = array('name' => 'test', 'debug' => true, 'ports' => array(80, 443));
+$counter = 1;
+$alias = &$counter;
+
+$py = <<<EOT
+import php
+
+g = php.globals
+print g['config']['name'], 'config' in g, 'missing' in g
+print g.get('missing', 'default')
+print 'counter' in g.keys(), 5 in g.keys()
+
+# Arrays are mappings that convert their elements as they are looked up.
+config = g['config']
+print config, sorted(config.keys()), len(config)
+print config['ports'][1], 1 in config['ports'], config.get('user')
+print sorted(config.copy().items())[0]
+g['copied'] = config['ports']
+g['counter'] = g['counter'] + 1
+g['created'] = [1, 2]
+del g['config']
+
+print php.request['_GET'].copy()
+print '_SERVER' in php.request, 'config' in php.request
+try:
+	php.request['config']
+except KeyError, e:
+	print 'KeyError', e
+EOT;
+
+python_exec($py);
+
+var_dump($alias, $created, $copied, isset($config));
+--EXPECT--
+test True False
+default
+True False
+<php.Array of 3 elements> ['debug', 'name', 'ports'] 3
+443 True None
+('debug', True)
+{'page': '2'}
+True False
+KeyError 'config'
+int(2)
+object(Python <type 'list'>)#1 (2) {
+  [0]=>
+  int(1)
+  [1]=>
+  int(2)
+}
+array(2) {
+  [0]=>
+  int(80)
+  [1]=>
+  int(443)
+}
+bool(false)
@@ -0,0 +1,31 @@
+--TEST--
+Python: php.Array of a global bound by reference
+--SKIPIF--
+<?php if (!extension_loaded('python')) die("skip\n");
+--FILE--
+<?php
+
+$cfg = array('a' => 1, 'b' => array(2, 3));
+$alias = &$cfg;
+
+/* Assigning through php.globals overwrites the reference in place. */
+$py = <<<EOT
+import php
+
+cfg = php.globals['cfg']
+php.globals['cfg'] = 5
+print cfg['a'], cfg['b'][1], len(cfg), sorted(cfg.keys())
+EOT;
+
+python_exec($py);
+var_dump($alias);
+
+/* So does assigning to it from PHP. */
+$alias = 'changed';
+python_exec("print cfg['a'], len(cfg['b'])");
+var_dump($cfg);
+--EXPECT--
+1 3 2 ['a', 'b']
+int(5)
+1 2
+string(7) "changed"
@@ -0,0 +1,24 @@
+--TEST--
+Python: python_buffer()
+--SKIPIF--
+<?php if (!extension_loaded('python')) die("skip\n");
+--FILE--
+<?php
+$py = <<<EOT
+def inspect(b):
+    return '%d %s %r' % (len(b), str(buffer(b)), b[0])
+EOT;
+python_exec($py);
+
+$data = str_repeat('abc', 3);
+$buffer = python_buffer($data);
+echo python_call('__main__', 'inspect', $buffer), "\n";
+
+/* Changing the original string must not affect the buffer. */
+$data[0] = 'X';
+echo $data, "\n";
+echo python_call('__main__', 'inspect', $buffer), "\n";
+--EXPECT--
+9 abcabcabc 97
+Xbcabcabc
+9 abcabcabc 97
@@ -0,0 +1,78 @@
+--TEST--
+Python: python_call_async()
+--SKIPIF--
+<?php if (!extension_loaded('python')) die("skip\n");
+--FILE--
+<?php
+
+$py = <<<EOT
+import threading
+
+lock = threading.Lock()
+started = []
+everyone = threading.Event()
+release = threading.Event()
+
+def gather(name):
+    # This only succeeds if all three calls are running at the same time.
+    lock.acquire()
+    started.append(name)
+    if len(started) == 3:
+        everyone.set()
+    lock.release()
+    everyone.wait(5)
+    if everyone.isSet():
+        return name.upper()
+
+def blocked(name):
+    release.wait()
+    return name.upper()
+
+def echo(name):
+    return name
+
+def fail():
+    raise ValueError('oops')
+EOT;
+
+python_exec($py);
+
+/* The three calls run concurrently. */
+$futures = array(
+	'a' => python_call_async('__main__', 'gather', 'a'),
+	'b' => python_call_async('__main__', 'gather', 'b'),
+	'c' => python_call_async('__main__', 'gather', 'c'),
+);
+echo get_class($futures['a']), "\n";
+var_dump(python_await_all($futures));
+
+/* This call can't finish until we release it. */
+$f = python_call_async('__main__', 'blocked', 'd');
+var_dump($f->done());
+var_dump(@$f->wait(0.01));
+python_exec("release.set()");
+var_dump($f->wait());
+var_dump($f->done());
+
+$f = python_call_async('__main__', 'fail');
+var_dump(@$f->wait());
+
+/* Unfinished futures are joined before the request ends. */
+$f = python_call_async('__main__', 'echo', 'e');
+echo "done\n";
+--EXPECT--
+PythonFuture
+array(3) {
+  ["a"]=>
+  string(1) "A"
+  ["b"]=>
+  string(1) "B"
+  ["c"]=>
+  string(1) "C"
+}
+bool(false)
+NULL
+string(1) "D"
+bool(true)
+NULL
+done
@@ -0,0 +1,33 @@
+--TEST--
+Python: python_capture() function
+--SKIPIF--
+<?php if (!extension_loaded('python')) die("skip\n");
+--FILE--
+<?php
+
+function inner()
+{
+    python_exec("print 'inner'");
+}
+
+function outer($arg)
+{
+    python_exec("print 'outer $arg'");
+    var_dump(python_capture('inner'));
+    echo "php\n";
+    python_exec("print 'done'");
+    return 42;
+}
+
+python_exec("import sys; sys.stdout.write('before\\n')");
+var_dump(python_capture('outer', 'arg'));
+python_exec("print 'after'");
+--EXPECT--
+before
+string(6) "inner
+"
+php
+string(15) "outer arg
+done
+"
+after
@@ -0,0 +1,31 @@
+--TEST--
+Python: python_compile()
+--SKIPIF--
+<?php if (!extension_loaded('python')) die("skip\n");
+--FILE--
+<?php
+$expr = python_compile("'%s:%s' % (a, b)", 'eval');
+echo get_class($expr), "\n";
+echo $expr->run(array('a' => 'x', 'b' => 'y')), "\n";
+echo $expr->run(array('a' => 'one', 'b' => 'two')), "\n";
+
+/* Statements run in their own namespace, not in __main__. */
+$stmt = python_compile("c = len(s)\nassert c == 3");
+var_dump($stmt->run(array('s' => 'abc')));
+var_dump(python_eval("'c' in globals()"));
+
+/* Variables don't carry over between runs. */
+$expr = python_compile("'s' in dir()", 'eval');
+var_dump($expr->run());
+
+var_dump(@python_compile("1 +", 'eval'));
+var_dump(@python_compile("1", 'bogus'));
+--EXPECT--
+PythonCode
+x:y
+one:two
+bool(true)
+int(0)
+int(0)
+bool(false)
+bool(false)
@@ -0,0 +1,56 @@
+--TEST--
+Python: python_run_coroutine() and python_gather_coroutines()
+--SKIPIF--
+<?php if (!extension_loaded('python')) die("skip\n");
+if (!@python_exec("import trollius")) die("skip trollius not installed\n");
+--FILE--
+<?php
+
+$py = <<<EOT
+import trollius
+from trollius import From, Return
+
+@trollius.coroutine
+def fetch(name, delay):
+    yield From(trollius.sleep(float(delay)))
+    raise Return(name.upper())
+
+@trollius.coroutine
+def fail():
+    yield From(trollius.sleep(0))
+    raise ValueError('oops')
+EOT;
+
+python_exec($py);
+
+var_dump(python_run_coroutine('__main__', 'fetch', 'one', '0.01'));
+
+/* The coroutines run concurrently. */
+$start = microtime(true);
+var_dump(@python_gather_coroutines(array(
+	'a' => array('__main__', 'fetch', 'a', '0.3'),
+	'b' => array('__main__', 'fetch', 'b', '0.3'),
+	'c' => array('__main__', 'fail'),
+)));
+var_dump(microtime(true) - $start < 0.5);
+
+/* The deadline cancels the whole group. */
+var_dump(@python_gather_coroutines(array(
+	array('__main__', 'fetch', 'slow', '5'),
+), 0.1));
+
+/* The loop persists for the rest of the request. */
+var_dump(python_run_coroutine('__main__', 'fetch', 'two', '0'));
+--EXPECT--
+string(3) "ONE"
+array(3) {
+  ["a"]=>
+  string(1) "A"
+  ["b"]=>
+  string(1) "B"
+  ["c"]=>
+  NULL
+}
+bool(true)
+bool(false)
+string(3) "TWO"
@@ -0,0 +1,46 @@
+--TEST--
+Python: python_exec_file()
+--SKIPIF--
+<?php if (!extension_loaded('python')) die("skip\n");
+--FILE--
+<?php
+$file = dirname(__FILE__) . '/python_exec_file.py';
+
+file_put_contents($file, "print greeting, __name__, __file__ == path\n");
+$globals = array('greeting' => 'hello', 'path' => $file);
+var_dump(python_exec_file($file, $globals));
+var_dump(python_exec_file($file, $globals));
+
+/* A modified file is recompiled. */
+file_put_contents($file, "print 'changed'\n");
+clearstatcache();
+var_dump(python_exec_file($file));
+
+/* An up-to-date .pyc file is used instead of the source. */
+file_put_contents($file, "print 'compiled'\n");
+clearstatcache();
+$mtime = filemtime($file);
+python_exec("import py_compile; py_compile.compile('" . addslashes($file) . "')");
+file_put_contents($file, "print 'source!!'\n");
+touch($file, $mtime);
+clearstatcache();
+var_dump(python_exec_file($file));
+
+var_dump(@python_exec_file(dirname(__FILE__) . '/python_exec_file_missing.py'));
+--CLEAN--
+<?php
+$file = dirname(__FILE__) . '/python_exec_file.py';
+@unlink($file);
+@unlink($file . 'c');
+@unlink($file . 'o');
+?>
+--EXPECT--
+hello __main__ True
+bool(true)
+hello __main__ True
+bool(true)
+changed
+bool(true)
+compiled
+bool(true)
+bool(false)
@@ -0,0 +1,57 @@
+--TEST--
+Python: python_pack_doubles(), python_pack_longs() and python_unpack()
+--SKIPIF--
+<?php if (!extension_loaded('python')) die("skip\n");
+--FILE--
+<?php
+$py = <<<EOT
+import array
+
+def describe(b):
+    return '%d %r' % (len(b), list(b))
+
+def to_array(b, code):
+    a = array.array(code)
+    a.fromstring(b)
+    return a.tolist() == list(b)
+EOT;
+python_exec($py);
+
+$doubles = python_pack_doubles(array(1.5, 2, '3.25'));
+$longs = python_pack_longs(array(1, 2.9, '3'));
+
+echo python_call('__main__', 'describe', $doubles), "\n";
+echo python_call('__main__', 'describe', $longs), "\n";
+var_dump(python_call('__main__', 'to_array', $doubles, 'd'));
+var_dump(python_call('__main__', 'to_array', $longs, 'l'));
+
+var_dump(python_unpack($doubles));
+var_dump(python_unpack($longs));
+var_dump(python_unpack(python_eval("array.array('h', [4, -5])")));
+--EXPECT--
+3 [1.5, 2.0, 3.25]
+3 [1, 2, 3]
+int(1)
+int(1)
+array(3) {
+  [0]=>
+  float(1.5)
+  [1]=>
+  float(2)
+  [2]=>
+  float(3.25)
+}
+array(3) {
+  [0]=>
+  int(1)
+  [1]=>
+  int(2)
+  [2]=>
+  int(3)
+}
+array(2) {
+  [0]=>
+  int(4)
+  [1]=>
+  int(-5)
+}
@@ -0,0 +1,42 @@
+--TEST--
+Python: python_parallel_map()
+--SKIPIF--
+<?php if (!extension_loaded('python')) die("skip\n");
+--FILE--
+<?php
+
+$py = <<<EOT
+def square(s):
+    return str(int(s) ** 2)
+
+def fail(s):
+    if s == '3':
+        raise ValueError('bad item')
+    return s
+EOT;
+
+python_exec($py);
+
+$items = array('1', '2', '3', '4', '5', '6', '7');
+$square = python_eval('square');
+echo implode(' ', python_parallel_map($square, $items, 3)), "\n";
+echo implode(' ', python_parallel_map($square, $items, 1)), "\n";
+echo implode(' ', python_parallel_map($square, $items, 20)), "\n";
+var_dump(python_parallel_map($square, array(), 4));
+var_dump(@python_parallel_map(python_eval('fail'), $items, 2));
+
+/* PHP callables run in the workers too, and their output is discarded. */
+echo implode(' ', python_parallel_map('strtoupper', array('a', 'b', 'c'), 2)), "\n";
+echo implode(' ', python_parallel_map(function ($s) { echo "hidden"; return $s . $s; },
+									  array('x', 'y'), 2)), "\n";
+var_dump(@python_parallel_map('no_such_function', $items));
+--EXPECT--
+1 4 9 16 25 36 49
+1 4 9 16 25 36 49
+1 4 9 16 25 36 49
+array(0) {
+}
+bool(false)
+A B C
+xx yy
+bool(false)
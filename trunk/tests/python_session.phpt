@@ -0,0 +1,26 @@
+--TEST--
+Python: python_session()
+--SKIPIF--
+<?php if (!extension_loaded('python')) die("skip\n");
+--FILE--
+<?php
+function work($prefix)
+{
+	$total = '';
+	for ($i = 0; $i < 3; $i++) {
+		$total .= python_eval("'$prefix%d' % $i");
+	}
+	return $total;
+}
+
+echo python_session('work', 'a'), "\n";
+
+/* Sessions nest. */
+echo python_session('python_session', 'work', 'b'), "\n";
+
+/* The thread state is released again afterward. */
+echo python_eval("'done'"), "\n";
+--EXPECT--
+a0a1a2
+b0b1b2
+done
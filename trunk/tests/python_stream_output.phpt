@@ -0,0 +1,42 @@
+--TEST--
+Python: python_stream_output() function
+--SKIPIF--
+<?php if (!extension_loaded('python')) die("skip\n");
+--INI--
+python.stream_flush_size=4
+--FILE--
+<?php
+
+function errorHandler($errno, $errstr, $errfile, $errline)
+{
+    echo "Error $errno: $errstr\n";
+}
+
+set_error_handler('errorHandler');
+
+$py = <<<EOT
+def rows(n):
+	print 'header'
+	for i in range(n):
+		yield 'row %d\\n' % i
+	yield u'caf\\xe9\\n'
+
+def bad():
+	yield 'ok\\n'
+	yield 42
+EOT;
+
+python_exec($py);
+
+var_dump(python_stream_output('__main__', 'rows', 3));
+var_dump(python_stream_output('__main__', 'bad'));
+--EXPECT--
+header
+row 0
+row 1
+row 2
+café
+int(24)
+ok
+Error 2: Python: [<type 'exceptions.TypeError'>] 'expected a string, got int'
+bool(false)
@@ -22,4 +22,3 @@ python_exec($py);
 --EXPECT--
 sys.stdout
 Error 8: sys.stderr
-Error 8:
@@ -0,0 +1,49 @@
+--TEST--
+Python: PHP streams as file objects
+--SKIPIF--
+<?php if (!extension_loaded('python')) die("skip\n");
+--FILE--
+<?php
+
+$py = <<<EOT
+def readall(s):
+	s.seek(0)
+	print repr(s.readline()), s.tell()
+	print [line for line in s]
+	s.seek(2)
+	buf = bytearray(3)
+	print s.readinto(buf), repr(str(buf))
+	print repr(s.read(4)), repr(s.read())
+
+def open_memory():
+	import php
+	s = php.Stream('php://memory', 'w+')
+	s.write('abc\\ndef\\n')
+	s.seek(0)
+	data = s.read()
+	s.close()
+	return data, s.closed
+EOT;
+
+python_exec($py);
+
+$fp = fopen('php://memory', 'w+');
+fwrite($fp, "one\ntwo\nthree\n");
+python_call('__main__', 'readall', $fp);
+
+var_dump(python_call('__main__', 'open_memory'));
+var_dump(is_resource($fp));
+--EXPECT--
+'one\n' 4
+['two\n', 'three\n']
+3 'e\nt'
+'wo\nt' 'hree\n'
+object(Python <type 'tuple'>)#1 (2) {
+  [0]=>
+  string(8) "abc
+def
+"
+  [1]=>
+  int(1)
+}
+bool(true)
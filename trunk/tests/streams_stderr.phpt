@@ -0,0 +1,41 @@
+--TEST--
+Python: sys.stderr entries
+--SKIPIF--
+<?php if (!extension_loaded('python')) die("skip\n");
+--INI--
+python.stderr_level=512
+--FILE--
+<?php
+
+function errorHandler($errno, $errstr, $errfile, $errline)
+{
+    echo "Error $errno: [$errstr]\n";
+}
+
+set_error_handler('errorHandler');
+
+/* Each line is its own entry, even when written in pieces. */
+python_exec("import sys\nsys.stderr.write('one\\ntw')\nsys.stderr.write('o\\n')");
+
+/* A traceback is a single entry. */
+$py = <<<EOT
+import traceback
+try:
+    1 / 0
+except:
+    traceback.print_exc()
+EOT;
+python_exec($py);
+
+/* Incomplete lines are sent when control returns to PHP. */
+python_exec("import sys\nprint 'out'\nsys.stderr.write('partial')");
+echo "end\n";
+--EXPECT--
+Error 512: [one]
+Error 512: [two]
+Error 512: [Traceback (most recent call last):
+  File "<string>", line 3, in <module>
+ZeroDivisionError: integer division or modulo by zero]
+out
+Error 512: [partial]
+end
@@ -0,0 +1,22 @@
+--TEST--
+Python: sys.stderr entries at a fatal python.stderr_level
+--SKIPIF--
+<?php if (!extension_loaded('python')) die("skip\n");
+--INI--
+python.stderr_level=1
+--FILE--
+<?php
+
+function errorHandler($errno, $errstr, $errfile, $errline)
+{
+    echo "Error $errno: [$errstr]\n";
+}
+
+set_error_handler('errorHandler');
+
+/* E_ERROR would end the request, so entries are raised as E_NOTICE. */
+python_exec("import sys\nsys.stderr.write('one\\n')");
+echo "end\n";
+--EXPECT--
+Error 8: [one]
+end
@@ -0,0 +1,24 @@
+--TEST--
+Python: sys.stdin reads the request body
+--SKIPIF--
+<?php if (!extension_loaded('python')) die("skip\n");
+--POST_RAW--
+Content-Type: text/plain
+first line
+second line
+third line
+--FILE--
+<?php
+
+$py = <<<EOT
+import sys
+print repr(sys.stdin.readline())
+print repr(sys.stdin.read(6))
+print [line for line in sys.stdin]
+EOT;
+
+python_exec($py);
+--EXPECT--
+'first line\n'
+'second'
+[' line\n', 'third line']